@@ -16,9 +16,22 @@
 
 #include "dataStructures.h"
 #include "matching2D.hpp"
+#include "bruteForceMatcher.hpp"
+#include "lshIndex.hpp"
+#include "sequenceMatcher.hpp"
+#include "keypointTracking.hpp"
+#include "trackTable.hpp"
 #include "objectDetection2D.hpp"
 #include "lidarData.hpp"
 #include "camFusion.hpp"
+#include "boxTracker.hpp"
+#include "threadBudget.hpp"
+#include "frameArena.hpp"
+#include "matPool.hpp"
+#include "stageTimer.hpp"
+#include "traceEvents.hpp"
+#include "perfCounters.hpp"
+#include "logger.hpp"
 
 #include <cstdio>
 
@@ -27,6 +40,8 @@ using namespace std;
 /* MAIN PROGRAM */
 int main(int argc, const char *argv[])
 {
+    double tProgramStart = (double)cv::getTickCount(); // for the time to the first TTC
+
     /* INIT VARIABLES AND DATA STRUCTURES */
 
     // data location
@@ -46,6 +61,54 @@ int main(int argc, const char *argv[])
     string yoloClassesFile = yoloBasePath + "coco.names";
     string yoloModelConfiguration = yoloBasePath + "yolov3.cfg";
     string yoloModelWeights = yoloBasePath + "yolov3.weights";
+    string yoloPrecision = "FP32";     // FP32, FP16, INT8 (see detectObjects)
+    string yoloInt8Model = "";         // quantized export of the same detector for INT8, e.g. yoloBasePath + "yolov3-int8.onnx"
+    string yoloOnnxBoxUnits = "PIXELS"; // box coordinates of the ONNX model: PIXELS (YOLOv5 export), NORMALIZED
+    setOnnxBoxUnits(yoloOnnxBoxUnits);
+    bool bInt8Onnx = yoloPrecision == "INT8" && !yoloInt8Model.empty();
+    bool bBenchmarkPrecision = false;  // compare FP32, FP16 and INT8 inference on every detected frame
+    bool bPreloadDetector = true;      // load the detector and run a warm-up inference before the first frame
+    bool bFirstTTC = true;
+
+    bool bFrameArena = true; // take the temporaries of the TTC stage from a per-frame arena instead of the heap
+    FrameArena frameArena;
+    FrameArena *ttcArena = bFrameArena ? &frameArena : nullptr;
+    long heapAllocsBefore = heapAllocationCount(); // -1 unless built with -DCOUNT_HEAP_ALLOCATIONS
+
+    bool bMatPool = true; // decode, convert and draw into image buffers of retired frames instead of fresh allocations
+    MatPool matPool;
+    vector<uchar> imgFileBytes; // encoded camera image, the buffer is reused from frame to frame
+    cv::Size imgSize;           // size of the last decoded camera image
+    long minorFaultsBefore = 0, majorFaultsBefore = 0;
+    pageFaultCount(minorFaultsBefore, majorFaultsBefore);
+
+    int logLevelMin = LOG_LEVEL_DEBUG; // LOG_LEVEL_INFO keeps only the per-stage summaries, e.g. for parameter sweeps
+    setLogLevel(logLevelMin);
+
+    bool bStageTiming = false;     // record every stage of every frame into latency histograms, reported at the end
+    string stageTimingFile = "";   // also export them, as JSON when the name ends with .json and as CSV otherwise
+    setStageTiming(bStageTiming);
+    string traceFile = "";         // trace-event JSON of all stages and functions for chrome://tracing or Perfetto, e.g. "../trace.json"
+    if (!traceFile.empty() && !startTrace(traceFile))
+        LOG_WARN("Could not open trace file ", traceFile);
+
+    bool bPerfCounters = false;    // count cycles, instructions, cache and branch misses of the hot stages (Linux only)
+    PerfCounters perfCounters(bPerfCounters);  // before OpenCV starts its worker threads, so they are counted too
+
+    bool bThreadBudget = false; // split the cores between the stages instead of letting OpenCV use all of them everywhere
+    bool bPinThreads = false;   // ... and keep the process on budgetCores cores
+    int budgetCores = 0;        // 0: all online cores
+    int workerCores = 0;        // cores kept for pipeline threads outside OpenCV
+    ThreadBudget threadBudget(budgetCores, workerCores);
+    if (bThreadBudget)
+    {
+        if (bPinThreads && !threadBudget.pinToCores())
+            LOG_WARN("CPU affinity is not supported, threads are not pinned");
+        threadBudget.setStage("DETECT", 1.0);    // DNN inference scales with the cores
+        threadBudget.setStage("LIDAR", 0.25);    // cropping and clustering are serial
+        threadBudget.setStage("KEYPOINTS", 1.0); // detectors, parallel description and matching
+        threadBudget.setStage("TTC", 0.25);
+    }
 
     // Lidar
     string lidarPrefix = "KITTI/2011_09_26/velodyne_points/data/000000";
@@ -72,7 +135,7 @@ int main(int argc, const char *argv[])
 
     // misc
     double sensorFrameRate = 10.0 / imgStepWidth; // frames per second for Lidar and camera
-    int dataBufferSize = 2;       // no. of images which are held in memory (ring buffer) at the same time
+    int dataBufferSize = 3;       // no. of images which are held in memory (ring buffer) at the same time, at least 3 for the older-frame lookups
     vector<DataFrame> dataBuffer; // list of data frames which are held in memory at the same time
     bool bVis = false;            // visualize results
 
@@ -85,42 +148,234 @@ int main(int argc, const char *argv[])
     string detectorType = "SHITOMASI";         //// -> SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE (only with AKAZE), SIFT (not with ORB)
 
     string descriptorType = "BRIEF"; //// ->  BRISK, BRIEF, ORB, FREAK, AKAZE(only with AKAZE), SIFT (change to HOG)
+    bool bParallelDesc = false;      // describe keypoint chunks concurrently (identical results, pays off for SIFT, BRISK, FREAK)
+    bool bBenchmarkMatcher = false;  // compare cv::BFMatcher with the SIMD Hamming matcher on every frame (binary descriptors)
+    bool bBenchmarkLsh = false;      // report recall and speed of the LSH index against brute force (binary descriptors)
+
+    bool bQuantizeDesc = false;       // store float descriptors (SIFT) as uint8, matched with the integer L2 kernel by MAT_SIMD
+    string descPcaFile = "";          // optional PCA for the quantization, trained offline with trainDescriptorPCA
+    bool bBenchmarkQuantized = false; // report agreement, memory and time of quantized against float descriptor matching
+
+    string matcherType = "MAT_FLANN";        // MAT_BF, MAT_FLANN, MAT_SIMD, MAT_LSH
+    string descriptorDataType = "DES_BINARY"; // DES_BINARY, DES_HOG
+    if(descriptorType == "SIFT")
+        descriptorDataType = "DES_HOG"; // DES_BINARY, DES_HOG
+    string selectorType = "SEL_KNN";       // SEL_NN, SEL_KNN
+    bool bCrossCheck = false;              // keep mutual nearest neighbors only (fused into the kernel with MAT_SIMD)
+
+    bool bPersistentMatcher = false; // build the matcher index once per frame and reuse it for the next frame pair
+    SequenceMatcher seqMatcher(matcherType, descriptorDataType, selectorType);
+
+    bool bGuidedMatching = false;    // only match keypoints within a window around their motion-predicted position
+    float guidedSearchRadius = 40.0; // radius of the search window in pixels
+    bool bBenchmarkGuided = false;   // report recall and speed of guided matching against brute force
+
+    string boxMatcherType = "BOX_KPT"; // BOX_KPT (keypoint votes), BOX_IOU (predicted box overlap, runs before keypoint matching)
+    bool bLimitKptsToBoxes = false;    // with BOX_IOU, only detect keypoints in the boxes which need a TTC
+
+    bool bTrackBoxes = false; // run YOLO only every yoloInterval frames and propagate the boxes with Kalman filters in between
+    int yoloInterval = 3;     // ... or earlier when the predicted box positions become too uncertain
+    BoxTracker boxTracker(yoloInterval);
+    int nYoloSkipped = 0;
+    double tYoloTotal = 0.0; // time spent in YOLO, to estimate the time saved on skipped frames
+    int nYoloRuns = 0;
+
+    // YOLO input sizes by increasing cost; the default 416x416 stretches the 1242x375 frames, the wide sizes do not
+    vector<cv::Size> yoloInputSizes = {cv::Size(608, 192), cv::Size(416, 416), cv::Size(832, 256)};
+    string yoloInputPolicy = "FIXED"; // FIXED (yoloInputSize), DIST (keep the farthest object large enough), LATENCY (yoloLatencyTarget)
+    cv::Size yoloInputSize(416, 416);
+    bool bLetterbox = false;          // scale uniformly and pad instead of stretching the frame to the input size
+    int minObjectInputHeight = 24;    // DIST: input pixels the smallest box of the previous frame should keep
+    double yoloLatencyTarget = 250.0; // LATENCY: ms per inference
+    vector<double> yoloLatencies(yoloInputSizes.size(), 0.0); // smoothed measured latency per input size [ms]
+    bool bBenchmarkYoloSizes = false; // report latency and box agreement of all input sizes on every detected frame
+
+    bool bGateDetection = false; // reuse the previous boxes instead of running YOLO when the scene has not changed
+    double gateThreshold = 2.0;  // mean absolute gray value difference (see sceneChange) below which nothing changed
+    int gateLevel = 2;           // pyramid level on which the frames are compared
+    int gateMaxReuse = 5;        // run YOLO after this many reuses in a row, so slow changes cannot accumulate
+    int nGateReused = 0;         // reuses in a row
+
+    bool bTrackKeypoints = false; // follow keypoints with KLT optical flow instead of detecting, describing and matching
+    int redetectInterval = 5;     // run the detector at least every n frames in tracking mode
+    int minTrackedKpts = 30;      // ... and whenever fewer tracks survive
+    float minTrackDistance = 5.0; // detections closer than this to a track (in pixels) are not added
+    int framesSinceDetection = 0;
+    double tKptsTotal[2] = {0.0, 0.0}; // cost of the keypoint stage (#5 - #7) with and without tracking
+    int nKptsFrames[2] = {0, 0};
+
+    bool bTrackTable = false; // keep keypoint tracks over several frames, continued through the matches
+    int ttcTrackFrames = 3;   // frames spanned by the tracks for the multi-frame camera TTC
+    bool bMultiFrameTTC = false; // report the multi-frame camera TTC (where available) instead of the frame pair one
+    TrackTable trackTable(ttcTrackFrames + 1);
+
+    cv::PCA descPca;
+    double descPcaScale = 1.0, descPcaOffset = 0.0;
+    bool bDescPca = bQuantizeDesc && !descPcaFile.empty() && loadDescriptorPCA(descPcaFile, descPca, descPcaScale, descPcaOffset);
+    cv::Mat descFloatPrev, descFloatCurr; // float descriptors of the last two frames for the quantization benchmark
+
+    if (bPreloadDetector)
+        initDetector(bInt8Onnx ? "" : yoloModelConfiguration, bInt8Onnx ? yoloInt8Model : yoloModelWeights, yoloPrecision,
+                     yoloInputSize);
 
     /* MAIN LOOP OVER ALL IMAGES */
 
     for (size_t imgIndex = 0; imgIndex <= imgEndIndex - imgStartIndex; imgIndex+=imgStepWidth)
     {
+        setTraceFrame((int)imgIndex);
+        ScopedStageTimer frameTimer(STAGE_HISTOGRAM("FRAME"));
+
         /* LOAD IMAGE INTO BUFFER */
 
+        ScopedStageTimer loadTimer(STAGE_HISTOGRAM("LOAD_IMAGE"));
+
         // assemble filenames for current index
         ostringstream imgNumber;
         imgNumber << setfill('0') << setw(imgFillWidth) << imgStartIndex + imgIndex;
         string imgFullFilename = imgBasePath + imgPrefix + imgNumber.str() + imgFileType;
 
+        // frames which are no longer looked at leave the buffer, their images go back to the pool
+        while (dataBuffer.size() >= (size_t)max(dataBufferSize, 3))
+        {
+            if (bMatPool)
+                matPool.retire(dataBuffer.front());
+            dataBuffer.erase(dataBuffer.begin());
+        }
+
         // load image from file 
-        cv::Mat img = cv::imread(imgFullFilename);
+        cv::Mat img;
+        if (bMatPool)
+        {
+            // imdecode writes into the given image when size and type match, so a retired frame's buffer is reused
+            ifstream imgFile(imgFullFilename, ios::binary | ios::ate);
+            bool bRead = false;
+            if (imgFile)
+            {
+                imgFileBytes.resize((size_t)imgFile.tellg());
+                imgFile.seekg(0);
+                bRead = !imgFileBytes.empty() && imgFile.read((char *)imgFileBytes.data(), imgFileBytes.size());
+            }
+            if (imgSize.area() > 0)
+                img = matPool.acquire(imgSize, CV_8UC3);
+            // a failed decode may leave the recycled buffer untouched, its stale pixels must not pass for this frame;
+            // like a failed imread, the frame gets an empty image
+            if (bRead && !cv::imdecode(imgFileBytes, cv::IMREAD_COLOR, &img).empty())
+                imgSize = img.size();
+            else
+                matPool.release(img);
+        }
+        else
+            img = cv::imread(imgFullFilename);
 
         // push image into data frame buffer
         DataFrame frame;
         frame.cameraImg = img;
-        dataBuffer.push_back(frame);
+        frame.imgCache.reset(img, bMatPool ? &matPool : nullptr);
+        img.release(); // the frame owns the image, so the pool can take it back on retirement
+        dataBuffer.push_back(std::move(frame));
 
 
-        cout << "#1 : LOAD IMAGE INTO BUFFER done" << endl;
+        loadTimer.stop();
+        LOG_INFO("#1 : LOAD IMAGE INTO BUFFER done");
 
 
         /* DETECT & CLASSIFY OBJECTS */
 
+        threadBudget.enterStage("DETECT");
+        ScopedStageTimer detectTimer(STAGE_HISTOGRAM("DETECT_OBJECTS"));
         float confThreshold = 0.2;
         float nmsThreshold = 0.4;        
-        detectObjects((dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->boundingBoxes, confThreshold, nmsThreshold,
-                      yoloBasePath, yoloClassesFile, yoloModelConfiguration, yoloModelWeights, bVis);
+        if (bTrackBoxes)
+            boxTracker.predict();
+        bool bYolo = !bTrackBoxes || boxTracker.needsDetection();
+        bool bReused = false;
+        double change = -1.0; // scene change, only measured when YOLO would run
+        if (bYolo && bGateDetection && dataBuffer.size() > 1 && nGateReused < gateMaxReuse)
+        {
+            change = sceneChange((dataBuffer.end() - 2)->imgCache, (dataBuffer.end() - 1)->imgCache,
+                                 (dataBuffer.end() - 2)->boundingBoxes, gateLevel);
+            bReused = change < gateThreshold;
+        }
+
+        if (bReused)
+        {
+            // the tracker coasts on its predictions: copied boxes are no measurements and must not reset its countdown
+            if (bTrackBoxes)
+                boxTracker.propagate((dataBuffer.end() - 1)->boundingBoxes);
+            else
+            {
+                for (const auto &prevBox : (dataBuffer.end() - 2)->boundingBoxes)
+                {
+                    BoundingBox bBox;
+                    bBox.boxID = prevBox.boxID;
+                    bBox.trackID = prevBox.trackID;
+                    bBox.roi = prevBox.roi;
+                    bBox.classID = prevBox.classID;
+                    bBox.confidence = prevBox.confidence;
+                    (dataBuffer.end() - 1)->boundingBoxes.push_back(bBox);
+                }
+            }
+            ++nGateReused;
+            ++nYoloSkipped;
+        }
+        else if (bYolo)
+        {
+            cv::Size inputSize = yoloInputSize;
+            int sizeIdx = -1;
+            if (yoloInputPolicy != "FIXED")
+            {
+                vector<BoundingBox> noBoxes;
+                sizeIdx = selectYoloInputSize(yoloInputPolicy, yoloInputSizes,
+                                              dataBuffer.size() > 1 ? (dataBuffer.end() - 2)->boundingBoxes : noBoxes,
+                                              (dataBuffer.end() - 1)->cameraImg.size(), bLetterbox, minObjectInputHeight,
+                                              yoloLatencies, yoloLatencyTarget);
+                inputSize = yoloInputSizes[sizeIdx];
+            }
 
-        cout << "#2 : DETECT & CLASSIFY OBJECTS done" << endl;
+            double tYolo = (double)cv::getTickCount(), tInference;
+            detectObjects((dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->boundingBoxes, confThreshold, nmsThreshold,
+                          yoloBasePath, yoloClassesFile, bInt8Onnx ? "" : yoloModelConfiguration,
+                          bInt8Onnx ? yoloInt8Model : yoloModelWeights, bVis, inputSize, bLetterbox, yoloPrecision, &tInference);
+            tYoloTotal += ((double)cv::getTickCount() - tYolo) / cv::getTickFrequency();
+            ++nYoloRuns;
+            if (sizeIdx >= 0)
+                yoloLatencies[sizeIdx] = yoloLatencies[sizeIdx] > 0.0 ? 0.8 * yoloLatencies[sizeIdx] + 200 * tInference : 1000 * tInference;
+            LOG_DEBUG("YOLO input ", inputSize.width, "x", inputSize.height, (bLetterbox ? " letterboxed" : ""), ", inference ",
+                      1000 * tInference, " ms");
+
+            if (bBenchmarkYoloSizes)
+                benchmarkYoloInputSizes((dataBuffer.end() - 1)->cameraImg, yoloInputSizes, confThreshold, nmsThreshold,
+                                        yoloBasePath, yoloClassesFile, yoloModelConfiguration, yoloModelWeights);
+            if (bBenchmarkPrecision)
+                benchmarkDetectorPrecision((dataBuffer.end() - 1)->cameraImg, confThreshold, nmsThreshold, yoloModelConfiguration,
+                                           yoloModelWeights, yoloInt8Model, inputSize);
+            if (bTrackBoxes)
+                boxTracker.update((dataBuffer.end() - 1)->boundingBoxes);
+            nGateReused = 0;
+        }
+        else
+        {
+            boxTracker.propagate((dataBuffer.end() - 1)->boundingBoxes);
+            ++nYoloSkipped;
+        }
+        detectTimer.stop();
+        double tDetect = detectTimer.elapsed();
+        // a skipped frame saves an average YOLO run less the time spent on gating or propagating instead
+        double tSaved = bReused || !bYolo ? max(tYoloTotal / max(nYoloRuns, 1) - tDetect, 0.0) : 0.0;
+
+        bool bDetectDetails = bTrackBoxes || bGateDetection;
+        LOG_INFO("#2 : DETECT & CLASSIFY OBJECTS done in ", 1000 * tDetect, " ms",
+                 logIf(bDetectDetails, " (", bReused ? "reused" : (bYolo ? "detected" : "propagated")),
+                 logIf(change >= 0.0, ", scene change ", change), logIf(bTrackBoxes, ", ", boxTracker.trackCount(), " tracks"),
+                 logIf(bDetectDetails, ", ~", 1000 * tSaved, " ms saved in this frame, "),
+                 logIf(bDetectDetails, "", nYoloSkipped, " frames skipped so far)"));
 
 
         /* CROP LIDAR POINTS */
 
+        threadBudget.enterStage("LIDAR");
+        ScopedStageTimer cropTimer(STAGE_HISTOGRAM("CROP_LIDAR"));
+
         // load 3D Lidar points from file
         string lidarFullFilename = imgBasePath + lidarPrefix + imgNumber.str() + lidarFileType;
         std::vector<LidarPoint> lidarPoints;
@@ -130,100 +385,180 @@ int main(int argc, const char *argv[])
         float minZ = -1.5, maxZ = -0.9, minX = 2.0, maxX = 20.0, maxY = 2.0, minR = 0.1; // focus on ego lane
         cropLidarPoints(lidarPoints, minX, maxX, maxY, minZ, maxZ, minR);
     
-        (dataBuffer.end() - 1)->lidarPoints = lidarPoints;
+        (dataBuffer.end() - 1)->lidarPoints = std::move(lidarPoints);
 
-        cout << "#3 : CROP LIDAR POINTS done" << endl;
+        cropTimer.stop();
+        LOG_INFO("#3 : CROP LIDAR POINTS done");
 
 
         /* CLUSTER LIDAR POINT CLOUD */
 
+        ScopedStageTimer clusterTimer(STAGE_HISTOGRAM("CLUSTER_LIDAR"));
+
         // associate Lidar points with camera-based ROI
         float shrinkFactor = 0.10; // shrinks each bounding box by the given percentage to avoid 3D object merging at the edges of an ROI
+        perfCounters.start();
         clusterLidarWithROI((dataBuffer.end()-1)->boundingBoxes, (dataBuffer.end() - 1)->lidarPoints, shrinkFactor, P_rect_00, R_rect_00, RT);
+        perfCounters.stop("clusterLidarWithROI", (long)(dataBuffer.end() - 1)->lidarPoints.size(), "point");
 
         // Visualize 3D objects
         bVis = false;
         if(bVis)
         {
-            cout << "image index " << imgIndex << endl;
-            show3DObjects((dataBuffer.end()-1)->boundingBoxes, cv::Size(4.0, 20.0), cv::Size(2000, 2000), true);
+            LOG_INFO("image index ", imgIndex);
+            show3DObjects((dataBuffer.end()-1)->boundingBoxes, (dataBuffer.end()-1)->lidarPoints, cv::Size(4.0, 20.0), cv::Size(2000, 2000), true);
         }
         bVis = false;
 
-        cout << "#4 : CLUSTER LIDAR POINT CLOUD done" << endl;
+        clusterTimer.stop();
+        LOG_INFO("#4 : CLUSTER LIDAR POINT CLOUD done");
+
+        // the IoU association needs no keypoints, so it runs before the keypoint stages and can restrict them
+        map<int, int> bbIoUMatches;
+        if (boxMatcherType == "BOX_IOU" && dataBuffer.size() > 1)
+        {
+            matchBoundingBoxesIoU(bbIoUMatches, *(dataBuffer.end() - 2), *(dataBuffer.end() - 1),
+                                  dataBuffer.size() > 2 ? &*(dataBuffer.end() - 3) : nullptr);
+        }
         
         
         // REMOVE THIS LINE BEFORE PROCEEDING WITH THE FINAL PROJECT
 
         /* DETECT IMAGE KEYPOINTS */
 
-        // convert current image to grayscale
-        cv::Mat imgGray;
-        cv::cvtColor((dataBuffer.end()-1)->cameraImg, imgGray, cv::COLOR_BGR2GRAY);
+        threadBudget.enterStage("KEYPOINTS");
+        ScopedStageTimer keypointTimer(STAGE_HISTOGRAM("DETECT_KEYPOINTS"));
 
-        // extract 2D keypoints from current image
-        vector<cv::KeyPoint> keypoints; // create empty feature list for current image
-//        string detectorType = "SHITOMASI";
+        // convert current image to grayscale (once per frame, shared with the descriptor extraction)
+        cv::Mat imgGray = (dataBuffer.end() - 1)->imgCache.gray();
 
-        if (detectorType == "SHITOMASI")
-        {
-            detKeypointsShiTomasi(keypoints, imgGray, false);
-        }
-        else if(detectorType == "HARRIS")
+        // in tracking mode the keypoints of the previous frame are followed with optical flow and the detector only runs
+        // every redetectInterval frames or when too few tracks survive
+        vector<cv::KeyPoint> trackedKpts;
+        vector<cv::DMatch> trackMatches;
+        bool bTracking = bTrackKeypoints && dataBuffer.size() > 1;
+        if (bTracking)
         {
-            detKeypointsHarris(keypoints, imgGray, false);
-        }
-        else if(detectorType == "FAST")
-        {
-            detKeypointsFAST(keypoints, imgGray, false);
-        }
-        else if(detectorType == "SIFT")
-        {
-            detKeypointsSIFT(keypoints, imgGray, false);
-        }
-        else if(detectorType == "ORB")
-        {
-            detKeypointsORB(keypoints, imgGray, false);
-        }
-        else if(detectorType == "AKAZE")
-        {
-            detKeypointsAKAZE(keypoints, imgGray, false);
-        }
-        else if(detectorType == "BRISK")
-        {
-            detKeypointsBRISK(keypoints, imgGray, false);
+            trackKeypointsKLT((dataBuffer.end() - 2)->imgCache, (dataBuffer.end() - 1)->imgCache, (dataBuffer.end() - 2)->keypoints,
+                              trackedKpts, trackMatches);
+            ++framesSinceDetection;
         }
+        bool bDetect = !bTracking || framesSinceDetection >= redetectInterval || (int)trackedKpts.size() < minTrackedKpts;
 
-        // optional : limit number of keypoints (helpful for debugging and learning)
-        bool bLimitKpts = true;
-        if (bLimitKpts)
+        // extract 2D keypoints from current image
+        vector<cv::KeyPoint> keypoints; // create empty feature list for current image
+//        string detectorType = "SHITOMASI";
+        if (bDetect)
         {
-            int maxKeypoints = 50;
+            if (detectorType == "SHITOMASI")
+            {
+                detKeypointsShiTomasi(keypoints, imgGray, false);
+            }
+            else if(detectorType == "HARRIS")
+            {
+                detKeypointsHarris(keypoints, imgGray, false);
+            }
+            else if(detectorType == "FAST")
+            {
+                detKeypointsFAST(keypoints, imgGray, false);
+            }
+            else if(detectorType == "SIFT")
+            {
+                detKeypointsSIFT(keypoints, imgGray, false);
+            }
+            else if(detectorType == "ORB")
+            {
+                detKeypointsORB(keypoints, imgGray, false);
+            }
+            else if(detectorType == "AKAZE")
+            {
+                detKeypointsAKAZE(keypoints, imgGray, false);
+            }
+            else if(detectorType == "BRISK")
+            {
+                detKeypointsBRISK(keypoints, imgGray, false);
+            }
+
+            // optional : limit number of keypoints (helpful for debugging and learning)
+            bool bLimitKpts = true;
+            if (bLimitKpts)
+            {
+                int maxKeypoints = 50;
 
-            if (detectorType.compare("SHITOMASI") == 0)
-            { // there is no response info, so keep the first 50 as they are sorted in descending quality order
-                keypoints.erase(keypoints.begin() + maxKeypoints, keypoints.end());
+                if (detectorType.compare("SHITOMASI") == 0)
+                { // there is no response info, so keep the first 50 as they are sorted in descending quality order
+                    keypoints.erase(keypoints.begin() + maxKeypoints, keypoints.end());
+                }
+                cv::KeyPointsFilter::retainBest(keypoints, maxKeypoints);
+                LOG_DEBUG(" NOTE: Keypoints have been limited!");
             }
-            cv::KeyPointsFilter::retainBest(keypoints, maxKeypoints);
-            cout << " NOTE: Keypoints have been limited!" << endl;
+
+            // only fresh detections are limited, tracked keypoints stay because the KLT matches refer to them
+            if (bLimitKptsToBoxes && boxMatcherType == "BOX_IOU" && dataBuffer.size() > 1)
+                limitKeypointsToBoxes(keypoints, bbIoUMatches, *(dataBuffer.end() - 2), *(dataBuffer.end() - 1));
         }
 
+        if (bTracking)
+        {
+            // tracks keep their indices, so the KLT matches stay valid after the new detections are appended
+            if (bDetect)
+                addDetectedKeypoints(trackedKpts, keypoints, minTrackDistance);
+            keypoints = trackedKpts;
+        }
+        if (bDetect)
+            framesSinceDetection = 0;
+
         // push keypoints and descriptor for current frame to end of data buffer
         (dataBuffer.end() - 1)->keypoints = keypoints;
 
-        cout << "#5 : DETECT KEYPOINTS done" << endl;
+        keypointTimer.stop();
+        LOG_INFO("#5 : DETECT KEYPOINTS done");
 
 
         /* EXTRACT KEYPOINT DESCRIPTORS */
 
+        ScopedStageTimer descriptorTimer(STAGE_HISTOGRAM("EXTRACT_DESCRIPTORS"));
+
+        // in tracking mode the matches come from optical flow (describing could also drop keypoints the matches refer to)
         cv::Mat descriptors;
+        if (bMatPool && !bTrackKeypoints && dataBuffer.size() > 1 && !(dataBuffer.end() - 2)->descriptors.empty())
+        {
+            // extractors write into the given matrix when no keypoint is dropped, otherwise they allocate as before
+            const cv::Mat &prevDescriptors = (dataBuffer.end() - 2)->descriptors;
+            descriptors = matPool.acquire((int)(dataBuffer.end() - 1)->keypoints.size(), prevDescriptors.cols, prevDescriptors.type());
+        }
 //        string descriptorType = "BRISK"; // BRISK, BRIEF, ORB, FREAK, AKAZE, SIFT
-        descKeypoints((dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->cameraImg, descriptors, descriptorType);
+        if (!bTrackKeypoints)
+        {
+            if (bParallelDesc)
+                descKeypointsParallel((dataBuffer.end() - 1)->keypoints, imgGray, descriptors, descriptorType);
+            else
+                descKeypoints((dataBuffer.end() - 1)->keypoints, imgGray, descriptors, descriptorType);
+        }
+
+        if (bQuantizeDesc && descriptors.type() == CV_32F)
+        {
+            descFloatPrev = descFloatCurr;
+            descFloatCurr = descriptors;
+            cv::Mat descQuantized;
+            quantizeDescriptors(descriptors, descQuantized, bDescPca ? &descPca : nullptr, descPcaScale, descPcaOffset);
+            descriptors = descQuantized;
+        }
 
         // push descriptors for current frame to end of data buffer
         (dataBuffer.end() - 1)->descriptors = descriptors;
 
-        cout << "#6 : EXTRACT DESCRIPTORS done" << endl;
+        // the persistent matcher indexes every frame's descriptors, including the first one
+        vector<cv::DMatch> seqMatches;
+        if (bPersistentMatcher && !bTrackKeypoints)
+            seqMatcher.matchNext((dataBuffer.end() - 1)->descriptors, seqMatches);
+
+        descriptorTimer.stop();
+        LOG_INFO("#6 : EXTRACT DESCRIPTORS done");
+
+        // the first frame has no matches, all of its keypoints start tracks
+        if (bTrackTable && dataBuffer.size() == 1)
+            updateTrackTable(trackTable, (dataBuffer.end() - 1)->keypoints, vector<cv::DMatch>());
 
 
         if (dataBuffer.size() > 1) // wait until at least two images have been processed
@@ -231,27 +566,85 @@ int main(int argc, const char *argv[])
 
             /* MATCH KEYPOINT DESCRIPTORS */
 
+            ScopedStageTimer matchTimer(STAGE_HISTOGRAM("MATCH_DESCRIPTORS"));
+
             vector<cv::DMatch> matches;
-            string matcherType = "MAT_FLANN";        // MAT_BF, MAT_FLANN
-            string descriptorDataType = "DES_BINARY"; // DES_BINARY, DES_HOG
-            if(descriptorType == "SIFT")
-                string descriptorType = "DES_HOG"; // DES_BINARY, DES_HOG
-            string selectorType = "SEL_KNN";       // SEL_NN, SEL_KNN
+            if (bTracking)
+            {
+                matches = trackMatches;
+            }
+            else if (bPersistentMatcher)
+            {
+                matches = seqMatches;
+            }
+            else if (bGuidedMatching)
+            {
+                // constant velocity prediction needs the frame before the previous one, the first pair uses no shifts
+                vector<cv::Point2f> kptShifts;
+                if (dataBuffer.size() > 2)
+                    predictKeypointShifts(*(dataBuffer.end() - 3), *(dataBuffer.end() - 2), kptShifts);
+                matchDescriptorsGuided((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
+                                       (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                       matches, descriptorDataType, selectorType, guidedSearchRadius, kptShifts);
+            }
+            else
+            {
+                perfCounters.start();
+                matchDescriptors((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
+                                 (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                 matches, descriptorDataType, matcherType, selectorType, bCrossCheck);
+                perfCounters.stop("matchDescriptors " + matcherType, (long)(dataBuffer.end() - 1)->keypoints.size(), "keypoint");
+            }
 
-            matchDescriptors((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
-                             (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
-                             matches, descriptorDataType, matcherType, selectorType);
+            // cost of the keypoint stage (#5 - #7) for comparing tracking with detection, description and matching
+            double tKpts = keypointTimer.elapsed() + descriptorTimer.elapsed() + matchTimer.elapsed();
+            tKptsTotal[bTracking] += tKpts;
+            ++nKptsFrames[bTracking];
+            LOG_DEBUG("Keypoint stage (", (bTracking ? (bDetect ? "KLT tracking + re-detection" : "KLT tracking") : "detect, describe, match"),
+                      ") took ", 1000 * tKpts, " ms");
+
+            if (bBenchmarkMatcher && !bTrackKeypoints && descriptorDataType == "DES_BINARY")
+            {
+                benchmarkHammingBF((dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors, descriptorType,
+                                   selectorType == "SEL_KNN" ? 0.8 : 0.0);
+            }
+            if (bBenchmarkLsh && !bTrackKeypoints && descriptorDataType == "DES_BINARY")
+            {
+                benchmarkLshIndex((dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors, descriptorType,
+                                  selectorType == "SEL_KNN" ? 0.8 : 0.0);
+            }
+
+            if (bBenchmarkQuantized && !descFloatPrev.empty() && (dataBuffer.end() - 1)->descriptors.type() == CV_8U)
+            {
+                benchmarkQuantizedL2(descFloatPrev, descFloatCurr, (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                     descriptorType, selectorType == "SEL_KNN" ? 0.8 : 0.0);
+            }
+            if (bBenchmarkGuided && !bTrackKeypoints)
+            {
+                vector<cv::Point2f> kptShifts;
+                if (dataBuffer.size() > 2)
+                    predictKeypointShifts(*(dataBuffer.end() - 3), *(dataBuffer.end() - 2), kptShifts);
+                benchmarkGuidedMatching((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
+                                        (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                        descriptorDataType, selectorType, guidedSearchRadius, kptShifts);
+            }
 
             // store matches in current data frame
             (dataBuffer.end() - 1)->kptMatches = matches;
 
-            cout << "#7 : MATCH KEYPOINT DESCRIPTORS done" << endl;
+            matchTimer.stop();
+            LOG_INFO("#7 : MATCH KEYPOINT DESCRIPTORS done");
+
+            if (bTrackTable)
+                updateTrackTable(trackTable, (dataBuffer.end() - 1)->keypoints, matches);
 
             // visualize matches between current and previous image
             bVis = true;
             if (bVis)
             {
-                cv::Mat matchImg = ((dataBuffer.end() - 1)->cameraImg).clone();
+                // drawMatches puts both images side by side and writes into matchImg when it already has that size
+                const cv::Mat &prevImg = (dataBuffer.end() - 2)->cameraImg, &currImg = (dataBuffer.end() - 1)->cameraImg;
+                cv::Mat matchImg = bMatPool ? matPool.acquire(max(prevImg.rows, currImg.rows), prevImg.cols + currImg.cols, currImg.type()) : cv::Mat();
                 cv::drawMatches((dataBuffer.end() - 2)->cameraImg, (dataBuffer.end() - 2)->keypoints,
                                 (dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->keypoints,
                                 matches, matchImg,
@@ -261,27 +654,39 @@ int main(int argc, const char *argv[])
                 string windowName = "Matching keypoints between two camera images";
                 cv::namedWindow(windowName, 7);
                 cv::imshow(windowName, matchImg);
-                cout << "Press key to continue to next image" << endl;
+                LOG_INFO("Press key to continue to next image");
                 cv::waitKey(0); // wait for key to be pressed
+                if (bMatPool)
+                    matPool.release(matchImg);
             }
             bVis = false;
             
             /* TRACK 3D OBJECT BOUNDING BOXES */
 
+            threadBudget.enterStage("TTC");
+            ScopedStageTimer trackTimer(STAGE_HISTOGRAM("TRACK_BOXES"));
+
             //// STUDENT ASSIGNMENT
             //// TASK FP.1 -> match list of 3D objects (vector<BoundingBox>) between current and previous frame (implement ->matchBoundingBoxes)
             map<int, int> bbBestMatches;
-            matchBoundingBoxes(matches, bbBestMatches, *(dataBuffer.end()-2), *(dataBuffer.end()-1)); // associate bounding boxes between current and previous frame using keypoint matches
+            if (boxMatcherType == "BOX_IOU") // repeated with the keypoint matches as tiebreaker, which takes microseconds
+                matchBoundingBoxesIoU(bbBestMatches, *(dataBuffer.end() - 2), *(dataBuffer.end() - 1),
+                                      dataBuffer.size() > 2 ? &*(dataBuffer.end() - 3) : nullptr, &matches);
+            else
+                matchBoundingBoxes(matches, bbBestMatches, *(dataBuffer.end()-2), *(dataBuffer.end()-1)); // associate bounding boxes between current and previous frame using keypoint matches
             //// EOF STUDENT ASSIGNMENT
 
             // store matches in current data frame
             (dataBuffer.end()-1)->bbMatches = bbBestMatches;
 
-            cout << "#8 : TRACK 3D OBJECT BOUNDING BOXES done" << endl;
+            trackTimer.stop();
+            LOG_INFO("#8 : TRACK 3D OBJECT BOUNDING BOXES done");
 
 
             /* COMPUTE TTC ON OBJECT IN FRONT */
 
+            ScopedStageTimer ttcTimer(STAGE_HISTOGRAM("COMPUTE_TTC"));
+
             bool bTTC = false;
             // loop over all BB match pairs
             for (auto it1 = (dataBuffer.end() - 1)->bbMatches.begin(); it1 != (dataBuffer.end() - 1)->bbMatches.end(); ++it1)
@@ -305,29 +710,46 @@ int main(int argc, const char *argv[])
                 }
 
                 // compute TTC for current match
-                if( currBB->lidarPoints.size()>0 && prevBB->lidarPoints.size()>0 ) // only compute TTC if we have Lidar points
+                if( !currBB->lidarRange.empty() && !prevBB->lidarRange.empty() ) // only compute TTC if we have Lidar points
                 {
                     //// STUDENT ASSIGNMENT
                     //// TASK FP.2 -> compute time-to-collision based on Lidar data (implement -> computeTTCLidar)
                     bTTC = true;
                     double ttcLidar; 
-                    computeTTCLidar(prevBB->lidarPoints, currBB->lidarPoints, sensorFrameRate, ttcLidar);
+                    perfCounters.start();
+                    computeTTCLidar((dataBuffer.end() - 2)->lidarPointsOf(*prevBB), (dataBuffer.end() - 1)->lidarPointsOf(*currBB), sensorFrameRate, ttcLidar, ttcArena);
+                    perfCounters.stop("computeTTCLidar", prevBB->lidarRange.size() + currBB->lidarRange.size(), "point");
                     //// EOF STUDENT ASSIGNMENT
 
                     //// STUDENT ASSIGNMENT
                     //// TASK FP.3 -> assign enclosed keypoint matches to bounding box (implement -> clusterKptMatchesWithROI)
                     //// TASK FP.4 -> compute time-to-collision based on camera (implement -> computeTTCCamera)
                     double ttcCamera;
-                    clusterKptMatchesWithROI(*currBB, (dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->kptMatches);
-                    if(!currBB->kptMatches.empty())
-                        computeTTCCamera((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints, currBB->kptMatches, sensorFrameRate, ttcCamera);
+                    clusterKptMatchesWithROI(*currBB, (dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->kptMatches,
+                                             (dataBuffer.end() - 1)->boxKptMatches, ttcArena);
+                    perfCounters.start();
+                    if(!currBB->kptMatchRange.empty())
+                        computeTTCCamera((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->kptMatchesOf(*currBB), sensorFrameRate, ttcCamera,
+                                         nullptr, ttcArena);
+                    perfCounters.stop("computeTTCCamera", currBB->kptMatchRange.size(), "keypoint");
+                    if (bTrackTable && trackTable.frameCount() > ttcTrackFrames)
+                    {
+                        double ttcCameraMulti;
+                        computeTTCCameraMultiFrame(trackTable, *currBB, ttcTrackFrames, sensorFrameRate, ttcCameraMulti);
+                        LOG_INFO("TTC Camera : ", ttcCamera, " s (frame pair), ", ttcCameraMulti, " s (over ", ttcTrackFrames, " frames)");
+                        if (bMultiFrameTTC && !std::isnan(ttcCameraMulti))
+                            ttcCamera = ttcCameraMulti;
+                    }
                     //// EOF STUDENT ASSIGNMENT
 
                     bVis = false;
                     if (bVis)
                     {
-                        cv::Mat visImg = (dataBuffer.end() - 1)->cameraImg.clone();
-                        showLidarImgOverlay(visImg, currBB->lidarPoints, P_rect_00, R_rect_00, RT, &visImg);
+                        const cv::Mat &currImg = (dataBuffer.end() - 1)->cameraImg;
+                        cv::Mat visImg = bMatPool ? matPool.acquire(currImg.size(), currImg.type()) : cv::Mat();
+                        currImg.copyTo(visImg);
+                        showLidarImgOverlay(visImg, (dataBuffer.end() - 1)->lidarPointsOf(*currBB), P_rect_00, R_rect_00, RT, &visImg,
+                                            bMatPool ? &matPool : nullptr);
                         cv::rectangle(visImg, cv::Point(currBB->roi.x, currBB->roi.y), cv::Point(currBB->roi.x + currBB->roi.width, currBB->roi.y + currBB->roi.height), cv::Scalar(0, 255, 0), 2);
                         
                         char str[200];
@@ -337,22 +759,84 @@ int main(int argc, const char *argv[])
                         string windowName = "Final Results : TTC";
                         cv::namedWindow(windowName, 4);
                         cv::imshow(windowName, visImg);
-                        cout << "Press key to continue to next frame" << endl;
+                        LOG_INFO("Press key to continue to next frame");
                         cv::waitKey(0);
+                        if (bMatPool)
+                            matPool.release(visImg);
                     }
                     bVis = false;
                     ttcLidarData.at(imgIndex-1) = ttcLidar;
                     ttcCameraData.at(imgIndex-1) = ttcCamera;
+                    if (bFirstTTC)
+                    {
+                        LOG_INFO("Time to first TTC : ", 1000 * ((double)cv::getTickCount() - tProgramStart) / cv::getTickFrequency(),
+                                 " ms (preload ", (bPreloadDetector ? "on" : "off"), ")");
+                        bFirstTTC = false;
+                    }
 
                 } // eof TTC computation
             } // eof loop over all BB matches
 
+            ttcTimer.stop();
             if(!bTTC)
-                cout << "Image index " << imgIndex <<"; No lidar points found for TTC calculation!" << endl;
+                LOG_INFO("Image index ", imgIndex,"; No lidar points found for TTC calculation!");
 
         }
 
+        threadBudget.leaveStage();
+        frameTimer.stop();
+
+        // the arena's temporaries end with the frame
+        long heapAllocs = heapAllocationCount();
+        if (heapAllocs >= 0)
+            LOG_DEBUG("Frame arena: ", frameArena.bytesUsed() / 1024, " KB used of ", frameArena.capacity() / 1024, " KB, ",
+                      frameArena.blockAllocations(), " block allocations, ", heapAllocs - heapAllocsBefore,
+                      " heap allocations in this frame");
+        else
+            LOG_DEBUG("Frame arena: ", frameArena.bytesUsed() / 1024, " KB used of ", frameArena.capacity() / 1024, " KB, ",
+                      frameArena.blockAllocations(), " block allocations");
+        frameArena.reset();
+        heapAllocsBefore = heapAllocs;
+
+        // page faults mostly come from touching freshly mapped image memory, which the pool avoids in steady state
+        long minorFaults, majorFaults;
+        if (pageFaultCount(minorFaults, majorFaults))
+        {
+            if (bMatPool)
+                LOG_DEBUG("Page faults: ", minorFaults - minorFaultsBefore, " minor, ", majorFaults - majorFaultsBefore,
+                          " major in this frame (image pool on), ", matPool.allocations(), " of ", matPool.acquisitions(),
+                          " pooled images allocated, ", matPool.bytesFree() / 1024, " KB free in the pool");
+            else
+                LOG_DEBUG("Page faults: ", minorFaults - minorFaultsBefore, " minor, ", majorFaults - majorFaultsBefore,
+                          " major in this frame (image pool off)");
+            minorFaultsBefore = minorFaults;
+            majorFaultsBefore = majorFaults;
+        }
+        matPool.resetStats();
+
     } // eof loop over all images
+
+    // the per-frame messages are written before the reports, which stay on cout
+    stopLogger();
+    threadBudget.restoreThreads();
+    if (bThreadBudget)
+        threadBudget.report();
+    perfCounters.report();
+    stopTrace();
+    if (bStageTiming)
+    {
+        reportStageTimings();
+        if (!stageTimingFile.empty() && !writeStageTimings(stageTimingFile))
+            cout << "Could not write stage timings to " << stageTimingFile << endl;
+    }
+
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        if (nKptsFrames[mode] > 0)
+            cout << "Average keypoint stage (" << (mode ? "KLT tracking" : "detect, describe, match") << "): "
+                 << 1000 * tKptsTotal[mode] / nKptsFrames[mode] << " ms over " << nKptsFrames[mode] << " frames" << endl;
+    }
+
     // saving lidar TTC
     if(std::freopen("../ttc/lidar_ttc.txt", "w", stdout)) {
         for(auto ttc: ttcLidarData){
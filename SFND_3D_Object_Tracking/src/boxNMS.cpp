@@ -0,0 +1,106 @@
+
+#include <algorithm>
+#include <climits>
+
+#include "boxNMS.hpp"
+
+using namespace std;
+
+BoxNMS::BoxNMS(int cellSize) : cellSize(max(8, cellSize))
+{
+}
+
+void BoxNMS::clear()
+{
+    boxes.clear();
+    classIds.clear();
+    scores.clear();
+}
+
+void BoxNMS::add(const cv::Rect &box, int classID, float score)
+{
+    boxes.push_back(box);
+    classIds.push_back(classID);
+    scores.push_back(score);
+}
+
+void BoxNMS::run(float nmsThreshold, std::vector<BoundingBox> &bBoxes)
+{
+    int n = (int)boxes.size();
+    if (n == 0)
+        return;
+
+    order.resize(n);
+    for (int i = 0; i < n; ++i)
+        order[i] = i;
+    sort(order.begin(), order.end(), [this](int a, int b) { return scores[a] > scores[b] || (scores[a] == scores[b] && a < b); });
+
+    // grid over the extent of all candidates (boxes may reach beyond the image)
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for (const auto &box : boxes)
+    {
+        x0 = min(x0, box.x);
+        y0 = min(y0, box.y);
+        x1 = max(x1, box.x + box.width);
+        y1 = max(y1, box.y + box.height);
+    }
+    int nCols = min(64, (x1 - x0) / cellSize + 1), nRows = min(64, (y1 - y0) / cellSize + 1);
+    int cellW = (x1 - x0) / nCols + 1, cellH = (y1 - y0) / nRows + 1;
+
+    cellHead.assign(nCols * nRows, -1);
+    entryNext.clear();
+    entryBox.clear();
+    lastTested.assign(n, -1);
+
+    for (int k = 0; k < n; ++k)
+    {
+        int i = order[k];
+        const cv::Rect &box = boxes[i];
+        int c0 = (box.x - x0) / cellW, c1 = min(nCols - 1, (box.x + box.width - x0) / cellW);
+        int r0 = (box.y - y0) / cellH, r1 = min(nRows - 1, (box.y + box.height - y0) / cellH);
+
+        // boxes which overlap share at least one cell
+        bool bSuppressed = false;
+        for (int r = r0; r <= r1 && !bSuppressed; ++r)
+        {
+            for (int c = c0; c <= c1 && !bSuppressed; ++c)
+            {
+                for (int e = cellHead[r * nCols + c]; e >= 0; e = entryNext[e])
+                {
+                    int j = entryBox[e];
+                    if (classIds[j] != classIds[i] || lastTested[j] == i)
+                        continue;
+                    lastTested[j] = i;
+
+                    double inter = (box & boxes[j]).area();
+                    double iou = inter / (box.area() + boxes[j].area() - inter);
+                    if (iou > nmsThreshold)
+                    {
+                        bSuppressed = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (bSuppressed)
+            continue;
+
+        for (int r = r0; r <= r1; ++r)
+        {
+            for (int c = c0; c <= c1; ++c)
+            {
+                entryNext.push_back(cellHead[r * nCols + c]);
+                entryBox.push_back(i);
+                cellHead[r * nCols + c] = (int)entryBox.size() - 1;
+            }
+        }
+
+        BoundingBox bBox;
+        bBox.roi = box;
+        bBox.classID = classIds[i];
+        bBox.confidence = scores[i];
+        bBox.boxID = (int)bBoxes.size(); // zero-based unique identifier for this bounding box
+        bBox.trackID = -1;               // set by BoxTracker
+        bBoxes.push_back(bBox);
+    }
+}
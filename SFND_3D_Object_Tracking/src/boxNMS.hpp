@@ -0,0 +1,41 @@
+#ifndef boxNMS_hpp
+#define boxNMS_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+// Class-aware non-maximum suppression for detector candidates. Candidates are visited in the order of decreasing score
+// and a candidate is kept unless it overlaps a kept box of the same class by more than the IoU threshold. Kept boxes are
+// registered in a uniform grid over the candidate extent, so every candidate is compared only with the kept boxes in the
+// cells it covers instead of with all of them. All buffers are members and keep their capacity, so an instance which is
+// reused for every frame does not allocate once it has seen the largest candidate set.
+class BoxNMS {
+public:
+    explicit BoxNMS(int cellSize=64);
+
+    void clear(); // drop all candidates
+    void add(const cv::Rect &box, int classID, float score);
+    int candidateCount() const { return (int)boxes.size(); }
+
+    // appends the kept boxes to bBoxes in the order of decreasing score, boxID continuing the IDs already in bBoxes
+    void run(float nmsThreshold, std::vector<BoundingBox> &bBoxes);
+
+private:
+    int cellSize;
+
+    // candidates
+    std::vector<cv::Rect> boxes;
+    std::vector<int> classIds;
+    std::vector<float> scores;
+    std::vector<int> order; // candidate indices by decreasing score
+
+    // grid of kept boxes: every cell holds a singly linked list of entries, a kept box has one entry per covered cell
+    std::vector<int> cellHead;   // first entry of every cell, -1 for an empty cell
+    std::vector<int> entryNext;  // next entry in the same cell
+    std::vector<int> entryBox;   // candidate index of the kept box
+    std::vector<int> lastTested; // per candidate: last candidate it has been tested against, avoids repeated IoU tests
+};
+
+#endif /* boxNMS_hpp */
@@ -0,0 +1,160 @@
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "boxTracker.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+BoxTracker::BoxTracker(int detectionInterval, double maxPositionStd, int maxMissed, double minIoU)
+    : detectionInterval(max(1, detectionInterval)), maxPositionStd(maxPositionStd), maxMissed(maxMissed), minIoU(minIoU),
+      nextTrackID(0), framesSinceDetection(0)
+{
+}
+
+cv::Rect BoxTracker::stateToRect(const cv::Mat &state)
+{
+    float cx = state.at<float>(0), cy = state.at<float>(1), w = max(state.at<float>(2), 1.0f), h = max(state.at<float>(3), 1.0f);
+    return cv::Rect(cvRound(cx - 0.5f * w), cvRound(cy - 0.5f * h), cvRound(w), cvRound(h));
+}
+
+void BoxTracker::startTrack(const BoundingBox &detection)
+{
+    Track track;
+    track.kf.init(8, 4, 0, CV_32F);
+
+    // constant velocity: every state moves by its velocity per frame
+    cv::setIdentity(track.kf.transitionMatrix);
+    for (int i = 0; i < 4; ++i)
+        track.kf.transitionMatrix.at<float>(i, i + 4) = 1.0f;
+    track.kf.measurementMatrix = cv::Mat::zeros(4, 8, CV_32F);
+    cv::setIdentity(track.kf.measurementMatrix);
+
+    // box positions from YOLO jitter by a few pixels, accelerations of a few pixels per frame are normal
+    cv::setIdentity(track.kf.processNoiseCov, cv::Scalar(1.0));
+    for (int i = 4; i < 8; ++i)
+        track.kf.processNoiseCov.at<float>(i, i) = 2.0f;
+    cv::setIdentity(track.kf.measurementNoiseCov, cv::Scalar(4.0));
+    cv::setIdentity(track.kf.errorCovPost, cv::Scalar(4.0));
+    for (int i = 4; i < 8; ++i)
+        track.kf.errorCovPost.at<float>(i, i) = 100.0f; // unknown initial velocity
+
+    const cv::Rect &roi = detection.roi;
+    track.kf.statePost = cv::Mat::zeros(8, 1, CV_32F);
+    track.kf.statePost.at<float>(0) = roi.x + 0.5f * roi.width;
+    track.kf.statePost.at<float>(1) = roi.y + 0.5f * roi.height;
+    track.kf.statePost.at<float>(2) = (float)roi.width;
+    track.kf.statePost.at<float>(3) = (float)roi.height;
+    track.kf.statePost.copyTo(track.kf.statePre);
+    track.kf.errorCovPost.copyTo(track.kf.errorCovPre);
+
+    track.trackID = nextTrackID++;
+    track.classID = detection.classID;
+    track.confidence = detection.confidence;
+    track.missed = 0;
+    tracks.push_back(track);
+}
+
+bool BoxTracker::needsDetection() const
+{
+    return tracks.empty() || framesSinceDetection >= detectionInterval || positionStd() > maxPositionStd;
+}
+
+void BoxTracker::predict()
+{
+    for (auto &track : tracks)
+        track.kf.predict();
+}
+
+double BoxTracker::positionStd() const
+{
+    double maxVar = 0.0;
+    for (const auto &track : tracks)
+        maxVar = max(maxVar, (double)max(track.kf.errorCovPre.at<float>(0, 0), track.kf.errorCovPre.at<float>(1, 1)));
+    return sqrt(maxVar);
+}
+
+void BoxTracker::update(std::vector<BoundingBox> &detections)
+{
+    framesSinceDetection = 0;
+
+    // greedy association of the predicted track boxes and the detections by decreasing IoU
+    vector<pair<double, pair<int, int>>> candidates;
+    for (size_t t = 0; t < tracks.size(); ++t)
+    {
+        cv::Rect predicted = stateToRect(tracks[t].kf.statePre);
+        for (size_t d = 0; d < detections.size(); ++d)
+        {
+            if (detections[d].classID != tracks[t].classID)
+                continue;
+            double inter = (predicted & detections[d].roi).area();
+            double iou = inter / (predicted.area() + detections[d].roi.area() - inter);
+            if (iou >= minIoU)
+                candidates.push_back(make_pair(iou, make_pair((int)t, (int)d)));
+        }
+    }
+    sort(candidates.begin(), candidates.end(), [](const pair<double, pair<int, int>> &a, const pair<double, pair<int, int>> &b) {
+        return a.first > b.first;
+    });
+
+    vector<bool> trackMatched(tracks.size(), false), detectionMatched(detections.size(), false);
+    for (const auto &candidate : candidates)
+    {
+        int t = candidate.second.first, d = candidate.second.second;
+        if (trackMatched[t] || detectionMatched[d])
+            continue;
+        trackMatched[t] = detectionMatched[d] = true;
+
+        const cv::Rect &roi = detections[d].roi;
+        cv::Mat measurement(4, 1, CV_32F);
+        measurement.at<float>(0) = roi.x + 0.5f * roi.width;
+        measurement.at<float>(1) = roi.y + 0.5f * roi.height;
+        measurement.at<float>(2) = (float)roi.width;
+        measurement.at<float>(3) = (float)roi.height;
+        tracks[t].kf.correct(measurement);
+        tracks[t].confidence = detections[d].confidence;
+        tracks[t].missed = 0;
+        detections[d].trackID = tracks[t].trackID;
+    }
+
+    // death of tracks which have not been detected for too long, birth of tracks for new objects
+    size_t nTracks = tracks.size();
+    for (size_t t = 0; t < nTracks; ++t)
+    {
+        if (!trackMatched[t])
+            ++tracks[t].missed;
+    }
+    int nEnded = (int)count_if(tracks.begin(), tracks.end(), [this](const Track &track) { return track.missed > maxMissed; });
+    tracks.erase(remove_if(tracks.begin(), tracks.end(), [this](const Track &track) { return track.missed > maxMissed; }), tracks.end());
+
+    int nStarted = 0;
+    for (size_t d = 0; d < detections.size(); ++d)
+    {
+        if (detectionMatched[d])
+            continue;
+        startTrack(detections[d]);
+        detections[d].trackID = tracks.back().trackID;
+        ++nStarted;
+    }
+
+    LOG_DEBUG("Box tracker: ", tracks.size(), " tracks (", nStarted, " started, ", nEnded, " ended)");
+}
+
+void BoxTracker::propagate(std::vector<BoundingBox> &bBoxes)
+{
+    ++framesSinceDetection;
+    bBoxes.clear();
+    for (const auto &track : tracks)
+    {
+        // a track which has just been missed keeps coasting on its prediction
+        BoundingBox bBox;
+        bBox.roi = stateToRect(track.kf.statePre);
+        bBox.classID = track.classID;
+        bBox.confidence = track.confidence;
+        bBox.trackID = track.trackID;
+        bBox.boxID = (int)bBoxes.size();
+        bBoxes.push_back(bBox); // KalmanFilter::predict has already made the prediction the new state estimate
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef boxTracker_hpp
+#define boxTracker_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "dataStructures.h"
+
+// Multi-object tracker for the YOLO bounding boxes. Every track owns a constant-velocity Kalman filter over box center
+// and size and their velocities (state cx, cy, w, h, vx, vy, vw, vh in pixels and pixels per frame). Detections are
+// associated with the predicted tracks greedily by IoU within a class; unmatched detections start new tracks and tracks
+// missed by more than maxMissed detection runs end. Between detection runs the predicted boxes replace YOLO.
+class BoxTracker {
+public:
+    // minIoU: association threshold; maxPositionStd: predicted center uncertainty (pixels) which forces a detection run
+    BoxTracker(int detectionInterval=3, double maxPositionStd=6.0, int maxMissed=1, double minIoU=0.3);
+
+    // true if the next frame needs detectObjects: no tracks yet, detectionInterval frames since the last detection, or
+    // a predicted center uncertainty above maxPositionStd (call after predict)
+    bool needsDetection() const;
+
+    // moves all tracks into the next frame; call once per frame before update or propagate
+    void predict();
+
+    // corrects the tracks with the detections of this frame, handles track birth and death and sets the trackID of
+    // every detection
+    void update(std::vector<BoundingBox> &detections);
+
+    // writes the predicted boxes of all tracks as the boxes of a frame without detection
+    void propagate(std::vector<BoundingBox> &bBoxes);
+
+    int trackCount() const { return (int)tracks.size(); }
+    double positionStd() const; // largest predicted center standard deviation over all tracks [pixels]
+
+private:
+    struct Track {
+        cv::KalmanFilter kf;
+        int trackID;
+        int classID;
+        double confidence;
+        int missed; // detection runs in a row without a matching detection
+    };
+
+    void startTrack(const BoundingBox &detection);
+    static cv::Rect stateToRect(const cv::Mat &state);
+
+    int detectionInterval;
+    double maxPositionStd;
+    int maxMissed;
+    double minIoU;
+
+    std::vector<Track> tracks;
+    int nextTrackID;
+    int framesSinceDetection;
+};
+
+#endif /* boxTracker_hpp */
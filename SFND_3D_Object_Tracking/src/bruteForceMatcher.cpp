@@ -0,0 +1,476 @@
+
+#include <iostream>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/features2d.hpp>
+
+#include "bruteForceMatcher.hpp"
+#include "logger.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BF_MATCHER_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const int kQueryTile = 32; // source descriptors which share one pass over a reference tile
+const int kRefTile = 256;  // reference descriptors per tile (16 KB for 64 byte descriptors, stays in L1)
+const int kBlockSize = 256; // source descriptors per parallel work item
+
+enum HammingKernel { KERNEL_SCALAR, KERNEL_AVX2, KERNEL_AVX512 };
+
+HammingKernel selectHammingKernel()
+{
+#ifdef BF_MATCHER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") &&
+        __builtin_cpu_supports("avx512vpopcntdq"))
+        return KERNEL_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return KERNEL_AVX2;
+#endif
+    return KERNEL_SCALAR;
+}
+
+HammingKernel hammingKernel()
+{
+    static const HammingKernel kernel = selectHammingKernel();
+    return kernel;
+}
+
+struct HammingScalar {
+    int operator()(const uchar *a, const uchar *b, int len) const
+    {
+        int dist = 0, i = 0;
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t x, y;
+            memcpy(&x, a + i, 8);
+            memcpy(&y, b + i, 8);
+            dist += __builtin_popcountll(x ^ y);
+        }
+        for (; i < len; ++i)
+            dist += __builtin_popcount(a[i] ^ b[i]);
+        return dist;
+    }
+    float distance(int raw) const { return (float)raw; }
+};
+
+struct L2SqrScalar {
+    int operator()(const uchar *a, const uchar *b, int len) const
+    {
+        int dist = 0;
+        for (int i = 0; i < len; ++i)
+        {
+            int d = (int)a[i] - (int)b[i];
+            dist += d * d;
+        }
+        return dist;
+    }
+    float distance(int raw) const { return sqrtf((float)raw); } // cv::NORM_L2 reports the root
+};
+
+// Two best distances per source descriptor. The current best pair lives in registers while a reference tile is
+// scanned; ties keep the lower reference index, as cv::BFMatcher does. Distances are compared as the integers the
+// kernel returns (popcount or squared L2) and converted to the reported distance only for the ratio test and output.
+// With CrossCheck, the same distances also update the best source descriptor of every reference descriptor (colBest
+// holds the distance, colBestIdx the source index; the lower source index wins ties because sources are visited in
+// increasing order). Returns the number of matches written to out.
+template <bool CrossCheck, typename Distance>
+inline __attribute__((always_inline)) int knnBlock(const Distance &dist, const cv::Mat &descSource, const cv::Mat &descRef,
+                                                   int qBegin, int qEnd, double minDescDistRatio, cv::DMatch *out,
+                                                   int *colBest, int *colBestIdx)
+{
+    const int len = descSource.cols, nRef = descRef.rows;
+    int best1[kQueryTile], best2[kQueryTile], bestIdx[kQueryTile];
+    int nOut = 0;
+
+    for (int q0 = qBegin; q0 < qEnd; q0 += kQueryTile)
+    {
+        int nq = min(kQueryTile, qEnd - q0);
+        fill(best1, best1 + nq, INT_MAX);
+        fill(best2, best2 + nq, INT_MAX);
+        fill(bestIdx, bestIdx + nq, -1);
+
+        for (int r0 = 0; r0 < nRef; r0 += kRefTile)
+        {
+            int r1 = min(nRef, r0 + kRefTile);
+            for (int q = 0; q < nq; ++q)
+            {
+                const uchar *query = descSource.ptr(q0 + q);
+                int b1 = best1[q], b2 = best2[q], idx = bestIdx[q];
+                for (int r = r0; r < r1; ++r)
+                {
+                    int d = dist(query, descRef.ptr(r), len);
+                    if (CrossCheck && d < colBest[r])
+                    {
+                        colBest[r] = d;
+                        colBestIdx[r] = q0 + q;
+                    }
+                    if (d < b2)
+                    {
+                        if (d < b1)
+                        {
+                            b2 = b1;
+                            b1 = d;
+                            idx = r;
+                        }
+                        else
+                            b2 = d;
+                    }
+                }
+                best1[q] = b1;
+                best2[q] = b2;
+                bestIdx[q] = idx;
+            }
+        }
+
+        // descriptor distance ratio test, evaluated exactly like the float ratio in matchDescriptors
+        for (int q = 0; q < nq; ++q)
+        {
+            if (bestIdx[q] < 0)
+                continue;
+            if (minDescDistRatio > 0 && best2[q] != INT_MAX && !(dist.distance(best1[q]) / dist.distance(best2[q]) < minDescDistRatio))
+                continue;
+            out[nOut++] = cv::DMatch(q0 + q, bestIdx[q], 0, dist.distance(best1[q]));
+        }
+    }
+    return nOut;
+}
+
+int knnBlockScalar(const cv::Mat &descSource, const cv::Mat &descRef, int qBegin, int qEnd, double minDescDistRatio, cv::DMatch *out,
+                   int *colBest, int *colBestIdx)
+{
+    if (colBest != nullptr)
+        return knnBlock<true>(HammingScalar(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+    return knnBlock<false>(HammingScalar(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+}
+
+int knnBlockL2Scalar(const cv::Mat &descSource, const cv::Mat &descRef, int qBegin, int qEnd, double minDescDistRatio, cv::DMatch *out,
+                     int *colBest, int *colBestIdx)
+{
+    if (colBest != nullptr)
+        return knnBlock<true>(L2SqrScalar(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+    return knnBlock<false>(L2SqrScalar(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+}
+
+#ifdef BF_MATCHER_X86
+
+// AVX2 has no vector popcount: count the bits of each nibble with a shuffle lookup and sum the bytes with SAD
+struct HammingAVX2 {
+    __attribute__((target("avx2,popcnt"))) int operator()(const uchar *a, const uchar *b, int len) const
+    {
+        const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                             0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i lowMask = _mm256_set1_epi8(0x0f);
+        __m256i acc = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+            __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, lowMask)),
+                                          _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask)));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+        }
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        int dist = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum));
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t x, y;
+            memcpy(&x, a + i, 8);
+            memcpy(&y, b + i, 8);
+            dist += (int)_mm_popcnt_u64(x ^ y);
+        }
+        for (; i < len; ++i)
+            dist += _mm_popcnt_u32(a[i] ^ b[i]);
+        return dist;
+    }
+    float distance(int raw) const { return (float)raw; }
+};
+
+// AVX-512 VPOPCNTDQ counts 32 bytes per instruction on 256 bit registers (a 32 byte ORB/BRIEF descriptor needs a single
+// popcount), the tail of odd-sized descriptors (AKAZE) is read with a masked load
+struct HammingAVX512 {
+    __attribute__((target("avx512f,avx512bw,avx512vl,avx512vpopcntdq"))) int operator()(const uchar *a, const uchar *b, int len) const
+    {
+        __m256i acc = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+            acc = _mm256_add_epi64(acc, _mm256_popcnt_epi64(x));
+        }
+        if (i < len)
+        {
+            __mmask32 mask = (__mmask32)((1ULL << (len - i)) - 1);
+            __m256i x = _mm256_xor_si256(_mm256_maskz_loadu_epi8(mask, a + i), _mm256_maskz_loadu_epi8(mask, b + i));
+            acc = _mm256_add_epi64(acc, _mm256_popcnt_epi64(x));
+        }
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum));
+    }
+    float distance(int raw) const { return (float)raw; }
+};
+
+// Squared L2 distance of uint8 descriptors: 16 bytes are widened to 16 bit, subtracted, and squared and pair-wise
+// summed into 32 bit lanes by madd (at most 2 * 255^2 per lane and step, no overflow for any descriptor length here)
+struct L2SqrAVX2 {
+    __attribute__((target("avx2"))) int operator()(const uchar *a, const uchar *b, int len) const
+    {
+        __m256i acc = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 16 <= len; i += 16)
+        {
+            __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+            __m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+            __m256i d = _mm256_sub_epi16(x, y);
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, d));
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+        int dist = _mm_cvtsi128_si32(sum);
+        for (; i < len; ++i)
+        {
+            int d = (int)a[i] - (int)b[i];
+            dist += d * d;
+        }
+        return dist;
+    }
+    float distance(int raw) const { return sqrtf((float)raw); }
+};
+
+__attribute__((target("avx2,popcnt")))
+int knnBlockAVX2(const cv::Mat &descSource, const cv::Mat &descRef, int qBegin, int qEnd, double minDescDistRatio, cv::DMatch *out,
+                 int *colBest, int *colBestIdx)
+{
+    if (colBest != nullptr)
+        return knnBlock<true>(HammingAVX2(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+    return knnBlock<false>(HammingAVX2(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl,avx512vpopcntdq")))
+int knnBlockAVX512(const cv::Mat &descSource, const cv::Mat &descRef, int qBegin, int qEnd, double minDescDistRatio, cv::DMatch *out,
+                   int *colBest, int *colBestIdx)
+{
+    if (colBest != nullptr)
+        return knnBlock<true>(HammingAVX512(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+    return knnBlock<false>(HammingAVX512(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+}
+
+__attribute__((target("avx2")))
+int knnBlockL2AVX2(const cv::Mat &descSource, const cv::Mat &descRef, int qBegin, int qEnd, double minDescDistRatio, cv::DMatch *out,
+                   int *colBest, int *colBestIdx)
+{
+    if (colBest != nullptr)
+        return knnBlock<true>(L2SqrAVX2(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+    return knnBlock<false>(L2SqrAVX2(), descSource, descRef, qBegin, qEnd, minDescDistRatio, out, colBest, colBestIdx);
+}
+
+#endif
+
+typedef int (*KnnBlockFn)(const cv::Mat &, const cv::Mat &, int, int, double, cv::DMatch *, int *, int *);
+
+void matchBlocks(KnnBlockFn knnBlockFn, const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches,
+                 double minDescDistRatio, bool crossCheck)
+{
+    // every source block writes its matches to the front of its own slot range, the gaps are closed afterwards
+    matches.resize(descSource.rows);
+    int nBlocks = (descSource.rows + kBlockSize - 1) / kBlockSize;
+    vector<int> blockMatches(nBlocks, 0);
+
+    // column bests of each worker are merged under a lock, ties go to the lower source index as within a worker
+    vector<int> colBest, colBestIdx;
+    if (crossCheck)
+    {
+        colBest.assign(descRef.rows, INT_MAX);
+        colBestIdx.assign(descRef.rows, -1);
+    }
+    mutex colBestMutex;
+
+    cv::parallel_for_(cv::Range(0, nBlocks), [&](const cv::Range &range) {
+        vector<int> workerBest, workerBestIdx;
+        if (crossCheck)
+        {
+            workerBest.assign(descRef.rows, INT_MAX);
+            workerBestIdx.assign(descRef.rows, -1);
+        }
+        for (int b = range.start; b < range.end; ++b)
+        {
+            int qBegin = b * kBlockSize, qEnd = min(descSource.rows, qBegin + kBlockSize);
+            blockMatches[b] = knnBlockFn(descSource, descRef, qBegin, qEnd, minDescDistRatio, &matches[qBegin],
+                                         crossCheck ? workerBest.data() : nullptr, workerBestIdx.data());
+        }
+        if (crossCheck)
+        {
+            lock_guard<mutex> lock(colBestMutex);
+            for (int r = 0; r < descRef.rows; ++r)
+            {
+                if (workerBest[r] < colBest[r] || (workerBest[r] == colBest[r] && workerBestIdx[r] < colBestIdx[r]))
+                {
+                    colBest[r] = workerBest[r];
+                    colBestIdx[r] = workerBestIdx[r];
+                }
+            }
+        }
+    });
+
+    // keep mutual nearest neighbors only: the source descriptor must also be the best one for its reference descriptor
+    int nMatches = 0;
+    for (int b = 0; b < nBlocks; ++b)
+    {
+        for (int i = 0; i < blockMatches[b]; ++i)
+        {
+            const cv::DMatch &match = matches[b * kBlockSize + i];
+            if (!crossCheck || colBestIdx[match.trainIdx] == match.queryIdx)
+                matches[nMatches++] = match;
+        }
+    }
+    matches.resize(nMatches);
+}
+
+} // namespace
+
+std::string hammingKernelName()
+{
+    switch (hammingKernel())
+    {
+        case KERNEL_AVX512: return "AVX-512";
+        case KERNEL_AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
+
+void matchHammingBF(const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches, double minDescDistRatio,
+                    bool crossCheck)
+{
+    matches.clear();
+    if (descSource.empty() || descRef.empty())
+        return;
+    CV_Assert(descSource.type() == CV_8U && descRef.type() == CV_8U && descSource.cols == descRef.cols);
+
+    KnnBlockFn knnBlockFn = knnBlockScalar;
+#ifdef BF_MATCHER_X86
+    if (hammingKernel() == KERNEL_AVX512)
+        knnBlockFn = knnBlockAVX512;
+    else if (hammingKernel() == KERNEL_AVX2)
+        knnBlockFn = knnBlockAVX2;
+#endif
+    matchBlocks(knnBlockFn, descSource, descRef, matches, minDescDistRatio, crossCheck);
+}
+
+void matchL2SqrBF(const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches, double minDescDistRatio,
+                  bool crossCheck)
+{
+    matches.clear();
+    if (descSource.empty() || descRef.empty())
+        return;
+    CV_Assert(descSource.type() == CV_8U && descRef.type() == CV_8U && descSource.cols == descRef.cols);
+
+    KnnBlockFn knnBlockFn = knnBlockL2Scalar;
+#ifdef BF_MATCHER_X86
+    if (hammingKernel() != KERNEL_SCALAR) // every AVX-512 CPU has AVX2, which is all the L2 kernel needs
+        knnBlockFn = knnBlockL2AVX2;
+#endif
+    matchBlocks(knnBlockFn, descSource, descRef, matches, minDescDistRatio, crossCheck);
+}
+
+void benchmarkHammingBF(const cv::Mat &descSource, const cv::Mat &descRef, std::string descriptorName, double minDescDistRatio)
+{
+    // reference: cv::BFMatcher followed by the ratio test as done in matchDescriptors
+    vector<cv::DMatch> bfMatches;
+    cv::Ptr<cv::DescriptorMatcher> matcher = cv::BFMatcher::create(cv::NORM_HAMMING, false);
+    double tBF = (double)cv::getTickCount();
+    if (minDescDistRatio > 0)
+    {
+        vector<vector<cv::DMatch>> knnMatches;
+        matcher->knnMatch(descSource, descRef, knnMatches, 2);
+        for (auto &knnMatch : knnMatches)
+        {
+            if (knnMatch.size() == 1 || (knnMatch.size() == 2 && knnMatch[0].distance / knnMatch[1].distance < minDescDistRatio))
+                bfMatches.push_back(knnMatch[0]);
+        }
+    }
+    else
+    {
+        matcher->match(descSource, descRef, bfMatches);
+    }
+    tBF = ((double)cv::getTickCount() - tBF) / cv::getTickFrequency();
+
+    vector<cv::DMatch> simdMatches;
+    double tSIMD = (double)cv::getTickCount();
+    matchHammingBF(descSource, descRef, simdMatches, minDescDistRatio);
+    tSIMD = ((double)cv::getTickCount() - tSIMD) / cv::getTickFrequency();
+
+    bool bIdentical = bfMatches.size() == simdMatches.size();
+    for (size_t i = 0; bIdentical && i < bfMatches.size(); ++i)
+    {
+        bIdentical = bfMatches[i].queryIdx == simdMatches[i].queryIdx && bfMatches[i].trainIdx == simdMatches[i].trainIdx &&
+                     bfMatches[i].distance == simdMatches[i].distance;
+    }
+
+    LOG_INFO(descriptorName, " matcher benchmark (", descSource.rows, " x ", descRef.rows, " descriptors, ",
+             descSource.cols, " bytes): BFMatcher ", 1000 * tBF, " ms, ", hammingKernelName(), " ",
+             1000 * tSIMD, " ms, speed-up ", tBF / max(tSIMD, 1e-9), ", results ",
+             (bIdentical ? "identical" : "DIFFER"));
+}
+
+void benchmarkQuantizedL2(const cv::Mat &descSourceF, const cv::Mat &descRefF, const cv::Mat &descSourceQ, const cv::Mat &descRefQ,
+                          std::string descriptorName, double minDescDistRatio)
+{
+    // reference: float descriptors with cv::BFMatcher followed by the ratio test as done in matchDescriptors
+    vector<cv::DMatch> floatMatches;
+    cv::Ptr<cv::DescriptorMatcher> matcher = cv::BFMatcher::create(cv::NORM_L2, false);
+    double tFloat = (double)cv::getTickCount();
+    if (minDescDistRatio > 0)
+    {
+        vector<vector<cv::DMatch>> knnMatches;
+        matcher->knnMatch(descSourceF, descRefF, knnMatches, 2);
+        for (auto &knnMatch : knnMatches)
+        {
+            if (knnMatch.size() == 1 || (knnMatch.size() == 2 && knnMatch[0].distance / knnMatch[1].distance < minDescDistRatio))
+                floatMatches.push_back(knnMatch[0]);
+        }
+    }
+    else
+    {
+        matcher->match(descSourceF, descRefF, floatMatches);
+    }
+    tFloat = ((double)cv::getTickCount() - tFloat) / cv::getTickFrequency();
+
+    vector<cv::DMatch> quantMatches;
+    double tQuant = (double)cv::getTickCount();
+    matchL2SqrBF(descSourceQ, descRefQ, quantMatches, minDescDistRatio);
+    tQuant = ((double)cv::getTickCount() - tQuant) / cv::getTickFrequency();
+
+    // share of the float matches which the quantized descriptors reproduce (both lists are sorted by queryIdx)
+    int nAgree = 0;
+    for (size_t i = 0, j = 0; i < floatMatches.size() && j < quantMatches.size();)
+    {
+        if (floatMatches[i].queryIdx < quantMatches[j].queryIdx)
+            ++i;
+        else if (floatMatches[i].queryIdx > quantMatches[j].queryIdx)
+            ++j;
+        else
+        {
+            nAgree += floatMatches[i].trainIdx == quantMatches[j].trainIdx;
+            ++i;
+            ++j;
+        }
+    }
+
+    size_t bytesFloat = descSourceF.total() * descSourceF.elemSize() + descRefF.total() * descRefF.elemSize();
+    size_t bytesQuant = descSourceQ.total() * descSourceQ.elemSize() + descRefQ.total() * descRefQ.elemSize();
+    LOG_INFO(descriptorName, " quantized matching benchmark (", descSourceF.cols, " floats -> ", descSourceQ.cols,
+             " bytes): agreement ", (floatMatches.empty() ? 100.0 : 100.0 * nAgree / floatMatches.size()), " % (",
+             nAgree, "/", floatMatches.size(), ", ", quantMatches.size(), " quantized matches), memory ",
+             bytesFloat / 1024.0, " KB -> ", bytesQuant / 1024.0, " KB, float BFMatcher ", 1000 * tFloat,
+             " ms, uint8 ", hammingKernelName(), " L2 ", 1000 * tQuant, " ms");
+}
@@ -0,0 +1,37 @@
+#ifndef bruteForceMatcher_hpp
+#define bruteForceMatcher_hpp
+
+#include <vector>
+#include <string>
+#include <opencv2/core.hpp>
+
+// Brute-force matching of binary descriptors (one CV_8U row per keypoint) in Hamming space. The two best reference
+// descriptors per source descriptor are kept in registers while cache-sized tiles of the reference descriptors are
+// scanned, and the descriptor distance ratio test is applied inside the kernel (minDescDistRatio <= 0 disables it and
+// returns the nearest neighbor for every source descriptor). Matches are written straight into a preallocated output,
+// source blocks are processed in parallel and the popcount kernel is chosen at runtime (AVX-512, AVX2 or scalar).
+// The result is identical to cv::BFMatcher(NORM_HAMMING) followed by the ratio test in matchDescriptors.
+// With crossCheck, the kernel also tracks the best source descriptor of every reference descriptor from the same
+// distances and only mutual nearest neighbors are kept (after the ratio test, if enabled). Without the ratio test this
+// equals cv::BFMatcher(NORM_HAMMING, true), at the cost of one pass instead of two.
+void matchHammingBF(const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches, double minDescDistRatio,
+                    bool crossCheck=false);
+
+// Brute-force matching of uint8 descriptors (e.g. quantized SIFT, see quantizeDescriptors) with the squared L2 distance
+// computed in integer arithmetic (AVX2 or scalar). Tiling, ratio test and output order are the same as for
+// matchHammingBF (including crossCheck); the reported distances are the L2 norms, as with cv::BFMatcher(NORM_L2).
+void matchL2SqrBF(const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches, double minDescDistRatio,
+                  bool crossCheck=false);
+
+// name of the popcount kernel selected for this CPU ("AVX-512", "AVX2" or "scalar")
+std::string hammingKernelName();
+
+// runs cv::BFMatcher and matchHammingBF on the same descriptors, checks that both agree and prints the timings
+void benchmarkHammingBF(const cv::Mat &descSource, const cv::Mat &descRef, std::string descriptorName, double minDescDistRatio);
+
+// matches float descriptors with cv::BFMatcher(NORM_L2) and their quantized versions with matchL2SqrBF, then prints
+// the share of float matches reproduced by the quantized descriptors, the memory of both and the timings
+void benchmarkQuantizedL2(const cv::Mat &descSourceF, const cv::Mat &descRefF, const cv::Mat &descSourceQ, const cv::Mat &descRefQ,
+                          std::string descriptorName, double minDescDistRatio);
+
+#endif /* bruteForceMatcher_hpp */
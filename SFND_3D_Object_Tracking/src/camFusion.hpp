@@ -6,20 +6,32 @@
 #include <vector>
 #include <opencv2/core.hpp>
 #include "dataStructures.h"
+#include "trackTable.hpp"
+#include "frameArena.hpp"
 
 
 void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<LidarPoint> &lidarPoints, float shrinkFactor, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT);
-void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches);
+// arena: frame arena for the temporaries of the TTC stage, null to take them from the heap
+void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches,
+                              std::vector<cv::DMatch> &boxKptMatches, FrameArena *arena=nullptr);
 void matchBoundingBoxes(std::vector<cv::DMatch> &matches, std::map<int, int> &bbBestMatches, DataFrame &prevFrame, DataFrame &currFrame);
+void matchBoundingBoxesIoU(std::map<int, int> &bbBestMatches, DataFrame &prevFrame, DataFrame &currFrame, DataFrame *olderFrame=nullptr,
+                           const std::vector<cv::DMatch> *kptMatches=nullptr, double minIoU=0.3);
+void limitKeypointsToBoxes(std::vector<cv::KeyPoint> &keypoints, const std::map<int, int> &bbMatches, DataFrame &prevFrame,
+                           DataFrame &currFrame, int margin=10);
+void predictKeypointShifts(DataFrame &olderFrame, DataFrame &prevFrame, std::vector<cv::Point2f> &kptShifts);
 
-void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size worldSize, cv::Size imageSize, bool bWait=true);
+void show3DObjects(std::vector<BoundingBox> &boundingBoxes, const std::vector<LidarPoint> &lidarPoints, cv::Size worldSize, cv::Size imageSize, bool bWait=true);
 
 void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr,
-                      std::vector<cv::DMatch> kptMatches, double frameRate, double &TTC, cv::Mat *visImg=nullptr);
-void computeTTCLidar(std::vector<LidarPoint> &lidarPointsPrev,
-                     std::vector<LidarPoint> &lidarPointsCurr, double frameRate, double &TTC);
+                      ArrayView<cv::DMatch> kptMatches, double frameRate, double &TTC, cv::Mat *visImg=nullptr,
+                      FrameArena *arena=nullptr);
+void computeTTCCameraMultiFrame(const TrackTable &tracks, const BoundingBox &currBB, int nFramesBack, double frameRate, double &TTC);
+void computeTTCLidar(ArrayView<LidarPoint> lidarPointsPrev,
+                     ArrayView<LidarPoint> lidarPointsCurr, double frameRate, double &TTC, FrameArena *arena=nullptr);
 
 void setDataFence(std::vector<double> data, std::pair<double, double> &fence, double factor= 1.5);
+void setDataFence(double *data, size_t n, std::pair<double, double> &fence, double factor= 1.5);
 bool isOutliers(double value, std::pair<double, double> fences);
 
 #endif /* camFusion_hpp */
@@ -2,28 +2,37 @@
 #include <iostream>
 #include <algorithm>
 #include <numeric>
+#include <climits>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "camFusion.hpp"
 #include "dataStructures.h"
+#include "frameArena.hpp"
+#include "traceEvents.hpp"
+#include "logger.hpp"
 
 using namespace std;
 
 
-// Create groups of Lidar points whose projection into the camera falls into the same bounding box
+// Create groups of Lidar points whose projection into the camera falls into the same bounding box; lidarPoints is
+// reordered so the points of every box are contiguous (in box order, see BoundingBox::lidarRange) and the points
+// enclosed by no or by several boxes come last
 void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<LidarPoint> &lidarPoints, float shrinkFactor, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT)
 {
+    TRACE_FUNCTION();
     // loop over all Lidar points and associate them to a 2D bounding box
     cv::Mat X(4, 1, cv::DataType<double>::type);
     cv::Mat Y(3, 1, cv::DataType<double>::type);
+    vector<int> pointBox(lidarPoints.size(), -1); // index of the only enclosing box, -1 for none or several
+    vector<int> boxCount(boundingBoxes.size() + 1, 0);
 
-    for (auto it1 = lidarPoints.begin(); it1 != lidarPoints.end(); ++it1)
+    for (size_t i = 0; i < lidarPoints.size(); ++i)
     {
         // assemble vector for matrix-vector-multiplication
-        X.at<double>(0, 0) = it1->x;
-        X.at<double>(1, 0) = it1->y;
-        X.at<double>(2, 0) = it1->z;
+        X.at<double>(0, 0) = lidarPoints[i].x;
+        X.at<double>(1, 0) = lidarPoints[i].y;
+        X.at<double>(2, 0) = lidarPoints[i].z;
         X.at<double>(3, 0) = 1;
 
         // project Lidar point into camera
@@ -33,32 +42,50 @@ void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<Li
         pt.x = Y.at<double>(0, 0) / Y.at<double>(2, 0); 
         pt.y = Y.at<double>(1, 0) / Y.at<double>(2, 0); 
 
-        vector<vector<BoundingBox>::iterator> enclosingBoxes; // pointers to all bounding boxes which enclose the current Lidar point
-        for (vector<BoundingBox>::iterator it2 = boundingBoxes.begin(); it2 != boundingBoxes.end(); ++it2)
+        int nEnclosing = 0; // number of bounding boxes which enclose the current Lidar point
+        for (size_t j = 0; j < boundingBoxes.size(); ++j)
         {
             // shrink current bounding box slightly to avoid having too many outlier points around the edges
+            const cv::Rect &roi = boundingBoxes[j].roi;
             cv::Rect smallerBox;
-            smallerBox.x = (*it2).roi.x + shrinkFactor * (*it2).roi.width / 2.0;
-            smallerBox.y = (*it2).roi.y + shrinkFactor * (*it2).roi.height / 2.0;
-            smallerBox.width = (*it2).roi.width * (1 - shrinkFactor);
-            smallerBox.height = (*it2).roi.height * (1 - shrinkFactor);
+            smallerBox.x = roi.x + shrinkFactor * roi.width / 2.0;
+            smallerBox.y = roi.y + shrinkFactor * roi.height / 2.0;
+            smallerBox.width = roi.width * (1 - shrinkFactor);
+            smallerBox.height = roi.height * (1 - shrinkFactor);
 
             // check wether point is within current bounding box
             if (smallerBox.contains(pt))
             {
-                enclosingBoxes.push_back(it2);
+                pointBox[i] = (int)j;
+                ++nEnclosing;
             }
 
         } // eof loop over all bounding boxes
 
         // check wether point has been enclosed by one or by multiple boxes
-        if (enclosingBoxes.size() == 1)
-        { 
-            // add Lidar point to bounding box
-            enclosingBoxes[0]->lidarPoints.push_back(*it1);
-        }
+        if (nEnclosing != 1)
+            pointBox[i] = -1;
+        ++boxCount[pointBox[i] >= 0 ? pointBox[i] : boundingBoxes.size()];
 
     } // eof loop over all Lidar points
+
+    // stable counting sort of the points by box
+    int begin = 0;
+    for (size_t j = 0; j <= boundingBoxes.size(); ++j)
+    {
+        int count = boxCount[j];
+        boxCount[j] = begin;
+        if (j < boundingBoxes.size())
+        {
+            boundingBoxes[j].lidarRange.begin = begin;
+            boundingBoxes[j].lidarRange.end = begin + count;
+        }
+        begin += count;
+    }
+    vector<LidarPoint> sortedPoints(lidarPoints.size());
+    for (size_t i = 0; i < lidarPoints.size(); ++i)
+        sortedPoints[boxCount[pointBox[i] >= 0 ? pointBox[i] : boundingBoxes.size()]++] = lidarPoints[i];
+    lidarPoints.swap(sortedPoints);
 }
 
 /* 
@@ -66,8 +93,9 @@ void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<Li
 * However, you can make this function work for other sizes too.
 * For instance, to use a 1000x1000 size, adjusting the text positions by dividing them by 2.
 */
-void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size worldSize, cv::Size imageSize, bool bWait)
+void show3DObjects(std::vector<BoundingBox> &boundingBoxes, const std::vector<LidarPoint> &lidarPoints, cv::Size worldSize, cv::Size imageSize, bool bWait)
 {
+    TRACE_FUNCTION();
     // create topview image
     cv::Mat topviewImg(imageSize, CV_8UC3, cv::Scalar(255, 255, 255));
 
@@ -80,7 +108,8 @@ void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size worldSize,
         // plot Lidar points into top view image
         int top=1e8, left=1e8, bottom=0.0, right=0.0; 
         float xwmin=1e8, ywmin=1e8, ywmax=-1e8;
-        for (auto it2 = it1->lidarPoints.begin(); it2 != it1->lidarPoints.end(); ++it2)
+        ArrayView<LidarPoint> boxPoints(lidarPoints, it1->lidarRange);
+        for (auto it2 = boxPoints.begin(); it2 != boxPoints.end(); ++it2)
         {
             // world coordinates
             float xw = (*it2).x; // world position in m with x facing forward from sensor
@@ -108,7 +137,7 @@ void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size worldSize,
 
         // augment object with some key data
         char str1[200], str2[200];
-        sprintf(str1, "id=%d, #pts=%d", it1->boxID, (int)it1->lidarPoints.size());
+        sprintf(str1, "id=%d, #pts=%d", it1->boxID, it1->lidarRange.size());
         putText(topviewImg, str1, cv::Point2f(left-250, bottom+50), cv::FONT_ITALIC, 2, currColor);
         sprintf(str2, "xmin=%2.2f m, yw=%2.2f m", xwmin, ywmax-ywmin);
         putText(topviewImg, str2, cv::Point2f(left-250, bottom+125), cv::FONT_ITALIC, 2, currColor);  
@@ -136,12 +165,16 @@ void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size worldSize,
 }
 
 
-// associate a given bounding box with the keypoints it contains
-void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches)
+// associate a given bounding box with the keypoints it contains; the matches are appended to boxKptMatches (the frame's
+// DataFrame::boxKptMatches) and referenced by boundingBox.kptMatchRange
+void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches,
+                              std::vector<cv::DMatch> &boxKptMatches, FrameArena *arena)
 {
-    vector<cv::DMatch> filteredMatches;
-    vector<double> d_data;
-    boundingBox.kptMatches.clear();
+    TRACE_FUNCTION();
+    ArenaAllocator<double> alloc(arena);
+    ArenaVector<cv::DMatch> filteredMatches(alloc);
+    ArenaVector<double> d_data(alloc);
+    boundingBox.kptMatchRange.begin = (int)boxKptMatches.size();
 
     // filtered by containing in keypoints
     for(auto & kptMatch : kptMatches){
@@ -158,33 +191,40 @@ void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint
 
     // filtered by IQR
     pair<double, double> fence;
-    setDataFence(d_data, fence);
+    ArenaVector<double> sorted(d_data.begin(), d_data.end(), alloc);
+    setDataFence(sorted.data(), sorted.size(), fence);
 
     for(auto i = 0; i < filteredMatches.size(); i++){
         if(!isOutliers(d_data.at(i), fence))
-            boundingBox.kptMatches.emplace_back(filteredMatches.at(i));
+            boxKptMatches.emplace_back(filteredMatches.at(i));
     }
-
+    boundingBox.kptMatchRange.end = (int)boxKptMatches.size();
 
 }
 
 
+
 // Compute time-to-collision (TTC) based on keypoint correspondences in successive images
-void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, 
-                      std::vector<cv::DMatch> kptMatches, double frameRate, double &TTC, cv::Mat *visImg)
+void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr,
+                      ArrayView<cv::DMatch> kptMatches, double frameRate, double &TTC, cv::Mat *visImg, FrameArena *arena)
 {
+    TRACE_FUNCTION();
+    ArenaAllocator<double> alloc(arena);
+
     // removing outliers by Interquartile Ranges (IQR)
-    vector<cv::KeyPoint> newKptsPrev, newKptsCurr;
+    ArenaVector<cv::KeyPoint> newKptsPrev(alloc), newKptsCurr(alloc);
 
     // filtering for previous  key points
-    vector<double> x, y;
+    ArenaVector<double> x(alloc), y(alloc);
+    x.reserve(max(kptsPrev.size(), kptsCurr.size()));
+    y.reserve(max(kptsPrev.size(), kptsCurr.size()));
     for(const auto& pt: kptsPrev){
         x.emplace_back(pt.pt.x);
         y.emplace_back(pt.pt.y);
     }
     pair<double, double> xFence, yFence;
-    setDataFence(x, xFence);
-    setDataFence(y, yFence);
+    setDataFence(x.data(), x.size(), xFence);
+    setDataFence(y.data(), y.size(), yFence);
     for(const auto& pt: kptsPrev){
         if(isOutliers(pt.pt.x, xFence) || isOutliers(pt.pt.y, yFence))
             continue;
@@ -197,8 +237,8 @@ void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPo
         x.emplace_back(pt.pt.x);
         y.emplace_back(pt.pt.y);
     }
-    setDataFence(x, xFence);
-    setDataFence(y, yFence);
+    setDataFence(x.data(), x.size(), xFence);
+    setDataFence(y.data(), y.size(), yFence);
     for(const auto& pt: kptsCurr){
         if(isOutliers(pt.pt.x, xFence) || isOutliers(pt.pt.y, yFence) )
             continue;
@@ -207,7 +247,7 @@ void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPo
 
 
     // compute distance ratios between all matched keypoints
-    vector<double> distRatios; // stores the distance ratios for all keypoints between curr. and prev. frame
+    ArenaVector<double> distRatios(alloc); // stores the distance ratios for all keypoints between curr. and prev. frame
     for (auto it1 = kptMatches.begin(); it1 != kptMatches.end() - 1; ++it1)
     { // outer keypoint loop
 
@@ -260,23 +300,51 @@ void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPo
 }
 
 
-void computeTTCLidar(std::vector<LidarPoint> &lidarPointsPrev,
-                     std::vector<LidarPoint> &lidarPointsCurr, double frameRate, double &TTC)
+// Compute camera-based TTC from keypoint tracks which span nFramesBack frames and end inside the current bounding box;
+// the longer baseline makes the distance ratios less sensitive to keypoint position noise than a single frame pair
+void computeTTCCameraMultiFrame(const TrackTable &tracks, const BoundingBox &currBB, int nFramesBack, double frameRate, double &TTC)
+{
+    TRACE_FUNCTION();
+    vector<cv::KeyPoint> kptsOld, kptsCurr;
+    vector<cv::DMatch> kptMatches;
+    tracks.correspondences(nFramesBack, currBB.roi, kptsOld, kptsCurr, kptMatches);
+    if (kptMatches.size() < 2)
+    {
+        TTC = NAN;
+        return;
+    }
+
+    // with constant velocity the TTC equation stays the same, only the time between the measurements grows
+    computeTTCCamera(kptsOld, kptsCurr, kptMatches, frameRate / nFramesBack, TTC);
+}
+
+
+void computeTTCLidar(ArrayView<LidarPoint> lidarPointsPrev,
+                     ArrayView<LidarPoint> lidarPointsCurr, double frameRate, double &TTC, FrameArena *arena)
 {
+    TRACE_FUNCTION();
+    ArenaAllocator<double> alloc(arena);
+
     // removing outliers by Interquartile Ranges (IQR)
-    vector<LidarPoint> newLidarPointsPrev, newLidarPointsCurr;
+    ArenaVector<LidarPoint> newLidarPointsPrev(alloc), newLidarPointsCurr(alloc);
+    newLidarPointsPrev.reserve(lidarPointsPrev.size());
+    newLidarPointsCurr.reserve(lidarPointsCurr.size());
 
     // filtering for previous lidar points
-    vector<double> x, y, z;
+    ArenaVector<double> x(alloc), y(alloc), z(alloc);
+    size_t maxPoints = max(lidarPointsPrev.size(), lidarPointsCurr.size());
+    x.reserve(maxPoints);
+    y.reserve(maxPoints);
+    z.reserve(maxPoints);
     for(const auto& pt: lidarPointsPrev){
         x.emplace_back(pt.x);
         y.emplace_back(pt.y);
         z.emplace_back(pt.z);
     }
     pair<double, double> xFence, yFence, zFence;
-    setDataFence(x, xFence);
-    setDataFence(y, yFence);
-    setDataFence(z, zFence);
+    setDataFence(x.data(), x.size(), xFence);
+    setDataFence(y.data(), y.size(), yFence);
+    setDataFence(z.data(), z.size(), zFence);
     for(const auto& pt: lidarPointsPrev){
         if(isOutliers(pt.x, xFence) || isOutliers(pt.y, yFence) || isOutliers(pt.z, zFence))
             continue;
@@ -290,9 +358,9 @@ void computeTTCLidar(std::vector<LidarPoint> &lidarPointsPrev,
         y.emplace_back(pt.y);
         z.emplace_back(pt.z);
     }
-    setDataFence(x, xFence);
-    setDataFence(y, yFence);
-    setDataFence(z, zFence);
+    setDataFence(x.data(), x.size(), xFence);
+    setDataFence(y.data(), y.size(), yFence);
+    setDataFence(z.data(), z.size(), zFence);
     for(const auto& pt: lidarPointsCurr){
         if(isOutliers(pt.x, xFence) || isOutliers(pt.y, yFence) || isOutliers(pt.z, zFence))
             continue;
@@ -319,9 +387,9 @@ void computeTTCLidar(std::vector<LidarPoint> &lidarPointsPrev,
     // compute TTC from both measurements
     TTC = minXCurr * dT / (minXPrev - minXCurr);}
 
-
 void matchBoundingBoxes(std::vector<cv::DMatch> &matches, std::map<int, int> &bbBestMatches, DataFrame &prevFrame, DataFrame &currFrame)
 {
+    TRACE_FUNCTION();
     // generteate a map from (previous_bouding box id, current_bouding box id) to the counts of matches
     map<pair<int, int>, int> bb_matches;
     for(const auto& bbp: prevFrame.boundingBoxes){
@@ -378,10 +446,198 @@ void matchBoundingBoxes(std::vector<cv::DMatch> &matches, std::map<int, int> &bb
 
 }
 
+static double boxIoU(const cv::Rect &a, const cv::Rect &b)
+{
+    double inter = (a & b).area();
+    double uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0.0;
+}
+
+// Associate the bounding boxes of the previous and current frame without keypoints: every previous box is moved by its
+// constant-velocity prediction (center shift and scale change since olderFrame, none for new tracks or without
+// olderFrame) and the pairs of the same class are taken greedily by decreasing IoU, requiring at least minIoU. Keypoint
+// matches, if given, only decide between pairs whose IoU is equal to two decimals.
+void matchBoundingBoxesIoU(std::map<int, int> &bbBestMatches, DataFrame &prevFrame, DataFrame &currFrame, DataFrame *olderFrame,
+                           const std::vector<cv::DMatch> *kptMatches, double minIoU)
+{
+    TRACE_FUNCTION();
+    auto t = static_cast<double>(cv::getTickCount());
+    bbBestMatches.clear();
+
+    // predicted boxes for the current frame
+    vector<cv::Rect> predicted;
+    for (const auto &prevBB : prevFrame.boundingBoxes)
+    {
+        cv::Rect2d box(prevBB.roi.x, prevBB.roi.y, prevBB.roi.width, prevBB.roi.height);
+        for (const auto &bbMatch : prevFrame.bbMatches)
+        {
+            if (olderFrame == nullptr || bbMatch.second != prevBB.boxID)
+                continue;
+            for (const auto &olderBB : olderFrame->boundingBoxes)
+            {
+                if (olderBB.boxID != bbMatch.first || olderBB.roi.area() == 0)
+                    continue;
+                double scale = sqrt((double)prevBB.roi.area() / olderBB.roi.area());
+                double cx = prevBB.roi.x + 0.5 * prevBB.roi.width, cy = prevBB.roi.y + 0.5 * prevBB.roi.height;
+                cx += cx - (olderBB.roi.x + 0.5 * olderBB.roi.width);
+                cy += cy - (olderBB.roi.y + 0.5 * olderBB.roi.height);
+                box = cv::Rect2d(cx - 0.5 * scale * prevBB.roi.width, cy - 0.5 * scale * prevBB.roi.height,
+                                 scale * prevBB.roi.width, scale * prevBB.roi.height);
+            }
+        }
+        predicted.push_back(cv::Rect(cvRound(box.x), cvRound(box.y), cvRound(box.width), cvRound(box.height)));
+    }
+
+    // keypoint votes per box pair (tiebreaker only)
+    vector<int> votes(prevFrame.boundingBoxes.size() * currFrame.boundingBoxes.size(), 0);
+    if (kptMatches != nullptr)
+    {
+        for (const auto &match : *kptMatches)
+        {
+            for (size_t i = 0; i < prevFrame.boundingBoxes.size(); ++i)
+            {
+                if (!prevFrame.boundingBoxes[i].roi.contains(prevFrame.keypoints[match.queryIdx].pt))
+                    continue;
+                for (size_t j = 0; j < currFrame.boundingBoxes.size(); ++j)
+                {
+                    if (currFrame.boundingBoxes[j].roi.contains(currFrame.keypoints[match.trainIdx].pt))
+                        ++votes[i * currFrame.boundingBoxes.size() + j];
+                }
+            }
+        }
+    }
+
+    struct Candidate {
+        int iouBin, votes;
+        double iou;
+        int prevIdx, currIdx;
+    };
+    vector<Candidate> candidates;
+    for (size_t i = 0; i < prevFrame.boundingBoxes.size(); ++i)
+    {
+        for (size_t j = 0; j < currFrame.boundingBoxes.size(); ++j)
+        {
+            if (prevFrame.boundingBoxes[i].classID != currFrame.boundingBoxes[j].classID)
+                continue;
+            double iou = boxIoU(predicted[i], currFrame.boundingBoxes[j].roi);
+            if (iou >= minIoU)
+                candidates.push_back({(int)(iou * 100.0), votes[i * currFrame.boundingBoxes.size() + j], iou, (int)i, (int)j});
+        }
+    }
+    sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        if (a.iouBin != b.iouBin)
+            return a.iouBin > b.iouBin;
+        if (a.votes != b.votes)
+            return a.votes > b.votes;
+        return a.iou > b.iou;
+    });
+
+    vector<bool> prevUsed(prevFrame.boundingBoxes.size(), false), currUsed(currFrame.boundingBoxes.size(), false);
+    for (const auto &candidate : candidates)
+    {
+        if (prevUsed[candidate.prevIdx] || currUsed[candidate.currIdx])
+            continue;
+        prevUsed[candidate.prevIdx] = currUsed[candidate.currIdx] = true;
+        bbBestMatches.emplace(prevFrame.boundingBoxes[candidate.prevIdx].boxID, currFrame.boundingBoxes[candidate.currIdx].boxID);
+    }
+
+    t = (static_cast<double>(cv::getTickCount()) - t) / cv::getTickFrequency();
+    LOG_DEBUG("IoU box association: ", bbBestMatches.size(), " of ", prevFrame.boundingBoxes.size(), " boxes matched in ",
+              1e6 * t, " us");
+}
+
+// Restrict keypoints to the current bounding boxes which take part in a TTC computation (matched to a previous box and
+// holding Lidar points in both frames); margin enlarges the boxes by the given number of pixels
+void limitKeypointsToBoxes(std::vector<cv::KeyPoint> &keypoints, const std::map<int, int> &bbMatches, DataFrame &prevFrame,
+                           DataFrame &currFrame, int margin)
+{
+    TRACE_FUNCTION();
+    vector<cv::Rect> rois;
+    for (const auto &bbMatch : bbMatches)
+    {
+        const BoundingBox *prevBB = nullptr, *currBB = nullptr;
+        for (const auto &bb : prevFrame.boundingBoxes)
+            prevBB = bb.boxID == bbMatch.first ? &bb : prevBB;
+        for (const auto &bb : currFrame.boundingBoxes)
+            currBB = bb.boxID == bbMatch.second ? &bb : currBB;
+        if (prevBB != nullptr && currBB != nullptr && !prevBB->lidarRange.empty() && !currBB->lidarRange.empty())
+            rois.push_back(cv::Rect(currBB->roi.x - margin, currBB->roi.y - margin, currBB->roi.width + 2 * margin, currBB->roi.height + 2 * margin));
+    }
+
+    size_t nBefore = keypoints.size();
+    keypoints.erase(remove_if(keypoints.begin(), keypoints.end(), [&rois](const cv::KeyPoint &kpt) {
+        for (const auto &roi : rois)
+        {
+            if (roi.contains(kpt.pt))
+                return false;
+        }
+        return true;
+    }), keypoints.end());
+    LOG_DEBUG("Keypoints limited to ", rois.size(), " TTC boxes: ", keypoints.size(), " of ", nBefore, " kept");
+}
+
+
+// Predict the image motion of every keypoint of prevFrame into the next frame assuming constant velocity since olderFrame:
+// keypoints inside a tracked bounding box move with the box center, all others with the median keypoint displacement
+// between olderFrame and prevFrame (prevFrame.kptMatches and prevFrame.bbMatches must refer to olderFrame)
+void predictKeypointShifts(DataFrame &olderFrame, DataFrame &prevFrame, std::vector<cv::Point2f> &kptShifts)
+{
+    TRACE_FUNCTION();
+    // background motion
+    cv::Point2f globalShift(0, 0);
+    if (!prevFrame.kptMatches.empty())
+    {
+        vector<float> dx, dy;
+        for (const auto &match : prevFrame.kptMatches)
+        {
+            cv::Point2f d = prevFrame.keypoints[match.trainIdx].pt - olderFrame.keypoints[match.queryIdx].pt;
+            dx.push_back(d.x);
+            dy.push_back(d.y);
+        }
+        nth_element(dx.begin(), dx.begin() + dx.size() / 2, dx.end());
+        nth_element(dy.begin(), dy.begin() + dy.size() / 2, dy.end());
+        globalShift = cv::Point2f(dx[dx.size() / 2], dy[dy.size() / 2]);
+    }
+    kptShifts.assign(prevFrame.keypoints.size(), globalShift);
+
+    // object motion, the smallest enclosing box wins where boxes overlap
+    vector<int> kptBoxArea(prevFrame.keypoints.size(), INT_MAX);
+    for (const auto &bbMatch : prevFrame.bbMatches)
+    {
+        const BoundingBox *olderBB = nullptr, *prevBB = nullptr;
+        for (const auto &bb : olderFrame.boundingBoxes)
+            olderBB = bb.boxID == bbMatch.first ? &bb : olderBB;
+        for (const auto &bb : prevFrame.boundingBoxes)
+            prevBB = bb.boxID == bbMatch.second ? &bb : prevBB;
+        if (olderBB == nullptr || prevBB == nullptr)
+            continue;
+
+        cv::Point2f boxShift(prevBB->roi.x + 0.5f * prevBB->roi.width - olderBB->roi.x - 0.5f * olderBB->roi.width,
+                             prevBB->roi.y + 0.5f * prevBB->roi.height - olderBB->roi.y - 0.5f * olderBB->roi.height);
+        for (size_t i = 0; i < prevFrame.keypoints.size(); ++i)
+        {
+            if (prevBB->roi.contains(prevFrame.keypoints[i].pt) && prevBB->roi.area() < kptBoxArea[i])
+            {
+                kptShifts[i] = boxShift;
+                kptBoxArea[i] = prevBB->roi.area();
+            }
+        }
+    }
+}
+
+
 void setDataFence(std::vector<double> data, std::pair<double, double> &fence, double factor) {
-    sort(data.begin(), data.end());
-    double Q1 =  data.at(static_cast<int>(data.size() * 0.25)); // Q1
-    double Q3 =  data.at(static_cast<int>(data.size() * 0.75)); // Q3
+    setDataFence(data.data(), data.size(), fence, factor);
+}
+
+// same fence without a copy; reorders data (the quartiles are selected in place instead of sorting everything)
+void setDataFence(double *data, size_t n, std::pair<double, double> &fence, double factor) {
+    CV_Assert(n > 0);
+    size_t i1 = static_cast<size_t>(n * 0.25), i3 = static_cast<size_t>(n * 0.75);
+    nth_element(data, data + i3, data + n);
+    double Q3 = data[i3]; // Q3
+    nth_element(data, data + i1, data + i3);
+    double Q1 = data[i1]; // Q1
     double IQR = Q3 - Q1 ;
     fence.first = Q1 - factor * IQR;
     fence.second = Q3 + factor * IQR;
@@ -6,11 +6,36 @@
 #include <map>
 #include <opencv2/core.hpp>
 
+#include "imageCache.hpp"
+
 struct LidarPoint { // single lidar point in space
     double x,y,z,r; // x,y,z in [m], r is point reflectivity
 };
 
-struct BoundingBox { // bounding box around a classified object (contains both 2D and 3D data)
+struct IndexRange { // elements [begin, end) of a frame-level array
+    int begin = 0, end = 0;
+
+    int size() const { return end - begin; }
+    bool empty() const { return end <= begin; }
+};
+
+template<typename T> struct ArrayView { // non-owning view of contiguous elements, valid while the array is unchanged
+    const T *first = nullptr;
+    size_t count = 0;
+
+    ArrayView() {}
+    ArrayView(const T *first, size_t count) : first(first), count(count) {}
+    ArrayView(const std::vector<T> &v) : first(v.data()), count(v.size()) {}
+    ArrayView(const std::vector<T> &v, IndexRange range) : first(v.data() + range.begin), count(range.size()) {}
+
+    const T *begin() const { return first; }
+    const T *end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T &operator[](size_t i) const { return first[i]; }
+};
+
+struct BoundingBox { // bounding box around a classified object; the 2D and 3D data it contains stay in its DataFrame
     
     int boxID; // unique identifier for this bounding box
     int trackID; // unique identifier for the track to which this bounding box belongs
@@ -19,22 +44,26 @@ struct BoundingBox { // bounding box around a classified object (contains both 2
     int classID; // ID based on class file provided to YOLO framework
     double confidence; // classification trust
 
-    std::vector<LidarPoint> lidarPoints; // Lidar 3D points which project into 2D image roi
-    std::vector<cv::KeyPoint> keypoints; // keypoints enclosed by 2D roi
-    std::vector<cv::DMatch> kptMatches; // keypoint matches enclosed by 2D roi
+    IndexRange lidarRange; // DataFrame::lidarPoints which project into 2D image roi
+    IndexRange kptMatchRange; // DataFrame::boxKptMatches enclosed by 2D roi
 };
 
 struct DataFrame { // represents the available sensor information at the same time instance
     
     cv::Mat cameraImg; // camera image
+    ImageCache imgCache; // gray image and pyramids derived from cameraImg, shared by all processing stages
     
     std::vector<cv::KeyPoint> keypoints; // 2D keypoints within camera image
     cv::Mat descriptors; // keypoint descriptors
     std::vector<cv::DMatch> kptMatches; // keypoint matches between previous and current frame
-    std::vector<LidarPoint> lidarPoints;
+    std::vector<LidarPoint> lidarPoints; // partitioned by bounding box, points in no or several boxes at the end
+    std::vector<cv::DMatch> boxKptMatches; // keypoint matches of the bounding boxes, one range per box
 
     std::vector<BoundingBox> boundingBoxes; // ROI around detected objects in 2D image coordinates
     std::map<int,int> bbMatches; // bounding box matches between previous and current frame
+
+    ArrayView<LidarPoint> lidarPointsOf(const BoundingBox &box) const { return ArrayView<LidarPoint>(lidarPoints, box.lidarRange); }
+    ArrayView<cv::DMatch> kptMatchesOf(const BoundingBox &box) const { return ArrayView<cv::DMatch>(boxKptMatches, box.kptMatchRange); }
 };
 
 #endif /* dataStructures_h */
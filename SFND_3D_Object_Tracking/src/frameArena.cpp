@@ -0,0 +1,95 @@
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <atomic>
+#include <algorithm>
+
+#include "frameArena.hpp"
+
+using namespace std;
+
+FrameArena::FrameArena(size_t blockSize) : blockUsed(0), used(0), nBlockAllocations(0)
+{
+    blocks.push_back(new char[blockSize]);
+    blockSizes.push_back(blockSize);
+}
+
+FrameArena::~FrameArena()
+{
+    for (char *block : blocks)
+        delete[] block;
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    uintptr_t base = (uintptr_t)blocks.back();
+    size_t offset = ((base + blockUsed + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    if (offset + bytes > blockSizes.back())
+    {
+        // the new block is at least twice the last one, so a growing frame needs few of them
+        size_t blockSize = max(2 * blockSizes.back(), bytes + alignment);
+        used += blockUsed;
+        blocks.push_back(new char[blockSize]);
+        blockSizes.push_back(blockSize);
+        ++nBlockAllocations;
+        base = (uintptr_t)blocks.back();
+        offset = ((base + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    }
+    blockUsed = offset + bytes;
+    return blocks.back() + offset;
+}
+
+void FrameArena::reset()
+{
+    if (blocks.size() > 1)
+    {
+        size_t total = capacity();
+        for (char *block : blocks)
+            delete[] block;
+        blocks.assign(1, new char[total]);
+        blockSizes.assign(1, total);
+    }
+    blockUsed = 0;
+    used = 0;
+    nBlockAllocations = 0;
+}
+
+size_t FrameArena::capacity() const
+{
+    size_t total = 0;
+    for (size_t size : blockSizes)
+        total += size;
+    return total;
+}
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+
+static atomic<long> heapAllocations(0);
+
+void *operator new(size_t size)
+{
+    heapAllocations.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+long heapAllocationCount()
+{
+    return heapAllocations.load(memory_order_relaxed);
+}
+
+#else
+
+long heapAllocationCount()
+{
+    return -1;
+}
+
+#endif
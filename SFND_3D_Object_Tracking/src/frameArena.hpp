@@ -0,0 +1,64 @@
+#ifndef frameArena_hpp
+#define frameArena_hpp
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Monotonic arena for the temporaries of one frame. Allocation bumps a pointer in the current block and deallocation
+// does nothing; reset() at the end of the frame releases everything at once. When a frame needed more than one block,
+// reset() replaces them by a single block of the combined size, so in steady state every frame is served from one
+// block and the arena makes no heap allocation at all.
+class FrameArena {
+public:
+    explicit FrameArena(size_t blockSize = 1 << 20);
+    ~FrameArena();
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment);
+    void reset();
+
+    size_t bytesUsed() const { return used + blockUsed; } // since the last reset
+    size_t capacity() const;
+    int blockAllocations() const { return nBlockAllocations; } // heap allocations made by the arena since the last reset
+
+private:
+    std::vector<char *> blocks;
+    std::vector<size_t> blockSizes;
+    size_t blockUsed; // bytes used in the current (last) block
+    size_t used;      // bytes used in all earlier blocks
+    int nBlockAllocations;
+};
+
+// std-compatible allocator drawing from a FrameArena, or from the heap like std::allocator when arena is null;
+// containers using an arena must not outlive the frame
+template<typename T> struct ArenaAllocator {
+    typedef T value_type;
+
+    FrameArena *arena;
+
+    explicit ArenaAllocator(FrameArena *arena = nullptr) : arena(arena) {}
+    template<typename U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n)
+    {
+        return arena ? static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))) : std::allocator<T>().allocate(n);
+    }
+    void deallocate(T *p, size_t n)
+    {
+        if (!arena)
+            std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template<typename T, typename U> bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena == b.arena; }
+template<typename T, typename U> bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+template<typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Number of global operator new calls since the start of the process, or -1 unless compiled with
+// -DCOUNT_HEAP_ALLOCATIONS, which replaces the global operator new with a counting one.
+long heapAllocationCount();
+
+#endif /* frameArena_hpp */
@@ -0,0 +1,73 @@
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "imageCache.hpp"
+#include "matPool.hpp"
+
+using namespace std;
+
+void ImageCache::reset(const cv::Mat &img, MatPool *pool)
+{
+    this->pool = pool;
+    colorImg = img;
+    grayImg.release();
+    gaussPyramid.clear();
+    opticalFlowPyramid.clear();
+    flowMaxLevel = -1;
+}
+
+void ImageCache::release(MatPool &pool)
+{
+    // the optical flow pyramid is allocated by OpenCV with padded levels and is simply dropped
+    for (auto &level : gaussPyramid)
+        pool.release(level);
+    pool.release(grayImg);
+    colorImg.release();
+    reset(cv::Mat(), this->pool);
+}
+
+const cv::Mat &ImageCache::gray()
+{
+    if (grayImg.empty())
+    {
+        if (colorImg.channels() == 1)
+            grayImg = colorImg;
+        else
+        {
+            // OpenCV writes into a destination of the right size and type instead of allocating a new one
+            if (pool)
+                grayImg = pool->acquire(colorImg.size(), CV_8UC1);
+            cv::cvtColor(colorImg, grayImg, cv::COLOR_BGR2GRAY);
+        }
+    }
+    return grayImg;
+}
+
+const std::vector<cv::Mat> &ImageCache::pyramid(int nLevels)
+{
+    // levels which have already been built are kept, only missing coarser levels are added
+    if (gaussPyramid.empty())
+        gaussPyramid.push_back(gray());
+    while ((int)gaussPyramid.size() < nLevels)
+    {
+        cv::Mat level;
+        if (pool)
+            level = pool->acquire((gaussPyramid.back().rows + 1) / 2, (gaussPyramid.back().cols + 1) / 2, gaussPyramid.back().type());
+        cv::pyrDown(gaussPyramid.back(), level);
+        gaussPyramid.push_back(level);
+    }
+    return gaussPyramid;
+}
+
+const std::vector<cv::Mat> &ImageCache::flowPyramid(cv::Size winSize, int maxLevel)
+{
+    // the Lucas-Kanade tracker needs levels with a border of winSize pixels, which the plain pyramid does not have
+    if (opticalFlowPyramid.empty() || flowWinSize != winSize || flowMaxLevel != maxLevel)
+    {
+        cv::buildOpticalFlowPyramid(gray(), opticalFlowPyramid, winSize, maxLevel);
+        flowWinSize = winSize;
+        flowMaxLevel = maxLevel;
+    }
+    return opticalFlowPyramid;
+}
@@ -0,0 +1,31 @@
+#ifndef imageCache_hpp
+#define imageCache_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+class MatPool;
+
+// per-frame cache of images derived from the camera image; every entry is computed once on first use and then shared
+// by all detectors, extractors and trackers which work on the same frame
+struct ImageCache {
+
+    void reset(const cv::Mat &img, MatPool *pool=nullptr); // drop all cached entries and attach a new camera image
+    void release(MatPool &pool); // hand all cached images to the pool and detach the camera image
+
+    const cv::Mat &color() const { return colorImg; }
+    const cv::Mat &gray(); // 8-bit gray image
+    const std::vector<cv::Mat> &pyramid(int nLevels); // Gaussian pyramid of the gray image, level 0 is the gray image
+    const std::vector<cv::Mat> &flowPyramid(cv::Size winSize, int maxLevel); // padded pyramid for cv::calcOpticalFlowPyrLK
+
+private:
+    cv::Mat colorImg;
+    cv::Mat grayImg;
+    std::vector<cv::Mat> gaussPyramid;
+    std::vector<cv::Mat> opticalFlowPyramid;
+    cv::Size flowWinSize;
+    int flowMaxLevel = -1;
+    MatPool *pool = nullptr; // source of the derived images, nullptr: allocated by OpenCV
+};
+
+#endif /* imageCache_hpp */
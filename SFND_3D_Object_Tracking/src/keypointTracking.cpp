@@ -0,0 +1,69 @@
+
+#include <iostream>
+#include <cmath>
+#include <opencv2/video/tracking.hpp>
+
+#include "keypointTracking.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+void trackKeypointsKLT(ImageCache &prevCache, ImageCache &currCache, std::vector<cv::KeyPoint> &kptsPrev,
+                       std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches,
+                       cv::Size winSize, int maxLevel, float maxFwdBwdError)
+{
+    kptsCurr.clear();
+    kptMatches.clear();
+    if (kptsPrev.empty())
+        return;
+
+    double t = (double)cv::getTickCount();
+    const vector<cv::Mat> &prevPyr = prevCache.flowPyramid(winSize, maxLevel);
+    const vector<cv::Mat> &currPyr = currCache.flowPyramid(winSize, maxLevel);
+
+    vector<cv::Point2f> ptsPrev, ptsCurr, ptsBack;
+    cv::KeyPoint::convert(kptsPrev, ptsPrev);
+    vector<uchar> statusFwd, statusBwd;
+    vector<float> err;
+    cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01);
+
+    // forward pass, then backward pass starting from the forward result
+    cv::calcOpticalFlowPyrLK(prevPyr, currPyr, ptsPrev, ptsCurr, statusFwd, err, winSize, maxLevel, criteria);
+    ptsBack = ptsPrev;
+    cv::calcOpticalFlowPyrLK(currPyr, prevPyr, ptsCurr, ptsBack, statusBwd, err, winSize, maxLevel, criteria,
+                             cv::OPTFLOW_USE_INITIAL_FLOW);
+
+    cv::Rect imgRect(0, 0, currPyr[0].cols, currPyr[0].rows);
+    float maxErrSq = maxFwdBwdError * maxFwdBwdError;
+    for (size_t i = 0; i < kptsPrev.size(); ++i)
+    {
+        cv::Point2f diff = ptsBack[i] - ptsPrev[i];
+        if (!statusFwd[i] || !statusBwd[i] || diff.x * diff.x + diff.y * diff.y > maxErrSq || !imgRect.contains(ptsCurr[i]))
+            continue;
+
+        cv::KeyPoint kpt = kptsPrev[i];
+        kpt.pt = ptsCurr[i];
+        kptMatches.push_back(cv::DMatch((int)i, (int)kptsCurr.size(), 0, sqrt(diff.x * diff.x + diff.y * diff.y)));
+        kptsCurr.push_back(kpt);
+    }
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    LOG_DEBUG("KLT tracking kept n=", kptsCurr.size(), " of ", kptsPrev.size(), " keypoints in ", 1000 * t / 1.0, " ms");
+}
+
+void addDetectedKeypoints(std::vector<cv::KeyPoint> &kptsTracked, const std::vector<cv::KeyPoint> &kptsDetected, float minDistance)
+{
+    size_t nTracked = kptsTracked.size();
+    float minDistSq = minDistance * minDistance;
+    for (const auto &kpt : kptsDetected)
+    {
+        bool bNearTrack = false;
+        for (size_t i = 0; i < nTracked && !bNearTrack; ++i)
+        {
+            cv::Point2f diff = kptsTracked[i].pt - kpt.pt;
+            bNearTrack = diff.x * diff.x + diff.y * diff.y < minDistSq;
+        }
+        if (!bNearTrack)
+            kptsTracked.push_back(kpt);
+    }
+}
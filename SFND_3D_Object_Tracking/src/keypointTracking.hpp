@@ -0,0 +1,22 @@
+#ifndef keypointTracking_hpp
+#define keypointTracking_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "imageCache.hpp"
+
+// Tracks the keypoints of the previous frame into the current frame with pyramidal Lucas-Kanade optical flow. Every
+// track is followed back into the previous frame and only kept if it returns to within maxFwdBwdError pixels of its
+// start and stays inside the image. kptsCurr receives the surviving tracks in the order of kptsPrev and kptMatches links
+// them like descriptor matching does (queryIdx = previous keypoint, trainIdx = current keypoint). The flow pyramids are
+// taken from the image caches, so the pyramid built for the current frame is reused when tracking into the next one.
+void trackKeypointsKLT(ImageCache &prevCache, ImageCache &currCache, std::vector<cv::KeyPoint> &kptsPrev,
+                       std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches,
+                       cv::Size winSize=cv::Size(21, 21), int maxLevel=3, float maxFwdBwdError=1.0);
+
+// appends detected keypoints to the tracked ones, skipping detections closer than minDistance to a track, so the indices
+// of the tracked keypoints and the matches pointing at them stay valid
+void addDetectedKeypoints(std::vector<cv::KeyPoint> &kptsTracked, const std::vector<cv::KeyPoint> &kptsDetected, float minDistance);
+
+#endif /* keypointTracking_hpp */
@@ -4,23 +4,25 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include "lidarData.hpp"
+#include "traceEvents.hpp"
 
 
 using namespace std;
 
-// remove Lidar points based on min. and max distance in X, Y and Z
+// remove Lidar points based on min. and max distance in X, Y and Z (in place, keeping the order of the remaining points)
 void cropLidarPoints(std::vector<LidarPoint> &lidarPoints, float minX, float maxX, float maxY, float minZ, float maxZ, float minR)
 {
-    std::vector<LidarPoint> newLidarPts; 
+    TRACE_FUNCTION();
+    auto newEnd = lidarPoints.begin();
     for(auto it=lidarPoints.begin(); it!=lidarPoints.end(); ++it) {
         
        if( (*it).x>=minX && (*it).x<=maxX && (*it).z>=minZ && (*it).z<=maxZ && (*it).z<=0.0 && abs((*it).y)<=maxY && (*it).r>=minR )  // Check if Lidar point is outside of boundaries
        {
-           newLidarPts.push_back(*it);
+           *newEnd++ = *it;
        }
     }
 
-    lidarPoints = newLidarPts;
+    lidarPoints.erase(newEnd, lidarPoints.end());
 }
 
 
@@ -28,6 +30,7 @@ void cropLidarPoints(std::vector<LidarPoint> &lidarPoints, float minX, float max
 // Load Lidar points from a given location and store them in a vector
 void loadLidarFromFile(vector<LidarPoint> &lidarPoints, string filename)
 {
+    TRACE_FUNCTION();
     // allocate 4 MB buffer (only ~130*4*4 KB are needed)
     unsigned long num = 1000000;
     float *data = (float*)malloc(num*sizeof(float));
@@ -55,6 +58,7 @@ void loadLidarFromFile(vector<LidarPoint> &lidarPoints, string filename)
 
 void showLidarTopview(std::vector<LidarPoint> &lidarPoints, cv::Size worldSize, cv::Size imageSize, bool bWait)
 {
+    TRACE_FUNCTION();
     // create topview image
     cv::Mat topviewImg(imageSize, CV_8UC3, cv::Scalar(0, 0, 0));
 
@@ -89,8 +93,10 @@ void showLidarTopview(std::vector<LidarPoint> &lidarPoints, cv::Size worldSize,
     }
 }
 
-void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Mat *extVisImg)
+void showLidarImgOverlay(cv::Mat &img, ArrayView<LidarPoint> lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Mat *extVisImg,
+                         MatPool *pool)
 {
+    TRACE_FUNCTION();
     // init image for visualization
     cv::Mat visImg; 
     if(extVisImg==nullptr)
@@ -101,7 +107,9 @@ void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv:
         visImg = *extVisImg;
     }
 
-    cv::Mat overlay = visImg.clone();
+    // the overlay only lives for this call, a pooled buffer avoids allocating a full image per box
+    cv::Mat overlay = pool ? pool->acquire(visImg.size(), visImg.type()) : cv::Mat();
+    visImg.copyTo(overlay);
 
     // find max. x-value
     double maxVal = 0.0; 
@@ -133,6 +141,8 @@ void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv:
 
     float opacity = 0.6;
     cv::addWeighted(overlay, opacity, visImg, 1 - opacity, 0, visImg);
+    if (pool)
+        pool->release(overlay);
 
     // return augmented image or wait if no image has been provided
     if (extVisImg == nullptr)
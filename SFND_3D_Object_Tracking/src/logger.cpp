@@ -0,0 +1,210 @@
+
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#include "logger.hpp"
+
+using namespace std;
+
+// bounded multi-producer queue after D. Vyukov: a slot's sequence number tells whether it is free for the producer at
+// that position or holds a record for the consumer
+struct LogSlot {
+    atomic<size_t> seq;
+    int level;
+    unsigned short size;
+    bool bTruncated;
+    char data[244];
+};
+
+static const size_t ringSize = 1024; // power of two
+static LogSlot ring[ringSize];
+static atomic<size_t> enqueuePos(0);
+static size_t dequeuePos = 0; // consumer only
+
+static atomic<int> runtimeLevel(LOG_LEVEL_DEBUG);
+static atomic<int> state(0); // 0: not started, 1: background thread running, 2: stopped
+static mutex startMutex;
+static thread writer;
+static mutex wakeupMutex;
+static condition_variable wakeup;
+static bool bStopWriter = false;
+static thread_local LogSlot directSlot; // used once the logger is stopped
+
+static void initRing()
+{
+    for (size_t i = 0; i < ringSize; ++i)
+        ring[i].seq.store(i, memory_order_relaxed);
+}
+
+static void format(const LogSlot &slot, ostringstream &line)
+{
+    if (slot.level == LOG_LEVEL_WARN)
+        line << "WARNING: ";
+    else if (slot.level == LOG_LEVEL_ERROR)
+        line << "ERROR: ";
+
+    const char *p = slot.data, *end = slot.data + slot.size;
+    while (p < end)
+    {
+        char tag = *p++;
+        switch (tag)
+        {
+        case LogRecord::TAG_LONG: { long long v; memcpy(&v, p, sizeof(v)); p += sizeof(v); line << v; break; }
+        case LogRecord::TAG_ULONG: { unsigned long long v; memcpy(&v, p, sizeof(v)); p += sizeof(v); line << v; break; }
+        case LogRecord::TAG_DOUBLE: { double v; memcpy(&v, p, sizeof(v)); p += sizeof(v); line << v; break; }
+        case LogRecord::TAG_BOOL: { bool v; memcpy(&v, p, sizeof(v)); p += sizeof(v); line << v; break; }
+        case LogRecord::TAG_CHAR: line << *p++; break;
+        case LogRecord::TAG_STRING:
+        {
+            unsigned short n;
+            memcpy(&n, p, sizeof(n));
+            p += sizeof(n);
+            line.write(p, n);
+            p += n;
+            break;
+        }
+        default: p = end; break;
+        }
+    }
+    if (slot.bTruncated)
+        line << "...";
+    line << '\n';
+}
+
+static void writeLine(const LogSlot &slot, ostringstream &line)
+{
+    line.str("");
+    format(slot, line);
+    const string &text = line.str();
+    fwrite(text.data(), 1, text.size(), stdout);
+}
+
+// formats and writes all committed records, returns their number
+static int drain(ostringstream &line)
+{
+    int n = 0;
+    for (;;)
+    {
+        LogSlot &slot = ring[dequeuePos & (ringSize - 1)];
+        if (slot.seq.load(memory_order_acquire) != dequeuePos + 1)
+            break;
+        writeLine(slot, line);
+        slot.seq.store(dequeuePos + ringSize, memory_order_release);
+        ++dequeuePos;
+        ++n;
+    }
+    return n;
+}
+
+static void writerLoop()
+{
+    ostringstream line;
+    unique_lock<mutex> lock(wakeupMutex);
+    while (!bStopWriter)
+    {
+        // producers only signal when the ring is full, otherwise the writer polls; one flush per batch instead of one per
+        // line, and an idle writer wakes up rarely
+        if (drain(line) > 0)
+            fflush(stdout);
+        else
+            wakeup.wait_for(lock, chrono::milliseconds(20));
+    }
+    drain(line);
+    fflush(stdout);
+}
+
+static void startLogger()
+{
+    lock_guard<mutex> lock(startMutex);
+    if (state.load() != 0)
+        return;
+    initRing();
+    writer = thread(writerLoop);
+    state.store(1, memory_order_release);
+}
+
+void setLogLevel(int level)
+{
+    runtimeLevel.store(level, memory_order_relaxed);
+}
+
+int logLevel()
+{
+    return runtimeLevel.load(memory_order_relaxed);
+}
+
+void stopLogger()
+{
+    lock_guard<mutex> lock(startMutex);
+    if (state.load() == 1)
+    {
+        {
+            lock_guard<mutex> wakeupLock(wakeupMutex);
+            bStopWriter = true;
+        }
+        wakeup.notify_one();
+        writer.join();
+    }
+    state.store(2, memory_order_release);
+}
+
+// ends the background thread at exit when main did not
+static struct LoggerShutdown {
+    ~LoggerShutdown() { stopLogger(); }
+} loggerShutdown;
+
+LogRecord::LogRecord(int level) : slot(nullptr), pos(0), bTruncated(false)
+{
+    if (state.load(memory_order_acquire) == 0)
+        startLogger();
+
+    LogSlot *s = &directSlot;
+    if (state.load(memory_order_acquire) == 1)
+    {
+        size_t p = enqueuePos.load(memory_order_relaxed);
+        for (;;)
+        {
+            s = &ring[p & (ringSize - 1)];
+            intptr_t diff = (intptr_t)s->seq.load(memory_order_acquire) - (intptr_t)p;
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(p, p + 1, memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                // ring full: wake the writer and wait for it rather than losing the message
+                wakeup.notify_one();
+                this_thread::yield();
+                p = enqueuePos.load(memory_order_relaxed);
+            }
+            else
+                p = enqueuePos.load(memory_order_relaxed);
+        }
+    }
+    s->level = level;
+    slot = s;
+    data = s->data;
+    capacity = sizeof(s->data);
+}
+
+LogRecord::~LogRecord()
+{
+    LogSlot *s = static_cast<LogSlot *>(slot);
+    s->size = (unsigned short)pos;
+    s->bTruncated = bTruncated;
+    if (s == &directSlot)
+    {
+        ostringstream line;
+        writeLine(*s, line);
+        return;
+    }
+    // the slot's position is implied by the sequence number the producer claimed it with
+    s->seq.store(s->seq.load(memory_order_relaxed) + 1, memory_order_release);
+}
@@ -0,0 +1,133 @@
+#ifndef logger_hpp
+#define logger_hpp
+
+#include <cstring>
+#include <string>
+
+// Leveled logger for the per-frame output. A call only copies its arguments in binary form into a slot of a lock-free
+// ring; a background thread formats them like an ostream would and writes whole batches to stdout, so the pipeline
+// threads neither format nor flush and lines of different threads never interleave.
+//
+//     LOG_INFO("FAST with n= ", keypoints.size(), " keypoints in ", 1000 * t, " ms");
+//
+// The arguments are concatenated. Calls below LOG_MIN_LEVEL (e.g. -DLOG_MIN_LEVEL=1 drops debug output) are removed
+// at compile time, their arguments are not even evaluated; setLogLevel() filters further at run time.
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+void setLogLevel(int level);
+int logLevel();
+void stopLogger(); // write all pending messages and end the background thread; later messages are written directly
+
+// one ring slot being filled by the calling thread, committed on destruction
+class LogRecord {
+public:
+    explicit LogRecord(int level);
+    ~LogRecord();
+    LogRecord(const LogRecord &) = delete;
+    LogRecord &operator=(const LogRecord &) = delete;
+
+    enum Tag : char { TAG_LONG, TAG_ULONG, TAG_DOUBLE, TAG_BOOL, TAG_CHAR, TAG_STRING };
+
+    void put(Tag tag, const void *value, size_t bytes)
+    {
+        if (pos + 1 + bytes > capacity)
+        {
+            bTruncated = true;
+            return;
+        }
+        data[pos++] = tag;
+        memcpy(data + pos, value, bytes);
+        pos += bytes;
+    }
+    void putString(const char *s, size_t length)
+    {
+        // strings are cut to the space left, the length is stored in front of the characters
+        size_t header = 1 + sizeof(unsigned short);
+        if (pos + header >= capacity)
+        {
+            bTruncated = true;
+            return;
+        }
+        if (length > capacity - pos - header)
+        {
+            length = capacity - pos - header;
+            bTruncated = true;
+        }
+        unsigned short n = (unsigned short)length;
+        data[pos++] = TAG_STRING;
+        memcpy(data + pos, &n, sizeof(n));
+        memcpy(data + pos + sizeof(n), s, length);
+        pos += sizeof(n) + length;
+    }
+
+private:
+    void *slot;
+    char *data;
+    size_t pos, capacity;
+    bool bTruncated;
+};
+
+inline void logArg(LogRecord &r, long long v) { r.put(LogRecord::TAG_LONG, &v, sizeof(v)); }
+inline void logArg(LogRecord &r, unsigned long long v) { r.put(LogRecord::TAG_ULONG, &v, sizeof(v)); }
+inline void logArg(LogRecord &r, int v) { logArg(r, (long long)v); }
+inline void logArg(LogRecord &r, long v) { logArg(r, (long long)v); }
+inline void logArg(LogRecord &r, unsigned v) { logArg(r, (unsigned long long)v); }
+inline void logArg(LogRecord &r, unsigned long v) { logArg(r, (unsigned long long)v); }
+inline void logArg(LogRecord &r, double v) { r.put(LogRecord::TAG_DOUBLE, &v, sizeof(v)); }
+inline void logArg(LogRecord &r, float v) { logArg(r, (double)v); }
+inline void logArg(LogRecord &r, bool v) { r.put(LogRecord::TAG_BOOL, &v, sizeof(v)); }
+inline void logArg(LogRecord &r, char v) { r.put(LogRecord::TAG_CHAR, &v, sizeof(v)); }
+inline void logArg(LogRecord &r, const char *s) { r.putString(s, strlen(s)); }
+inline void logArg(LogRecord &r, const std::string &s) { r.putString(s.data(), s.size()); }
+
+// a part of a message which is only written when bShow holds, e.g. logIf(bTrackBoxes, ", ", nTracks, " tracks"); the
+// value is still copied in binary form, so optional parts need not be formatted by the caller
+template<typename T> struct LogOptional {
+    bool bShow;
+    const char *prefix;
+    T value;
+    const char *suffix;
+};
+template<typename T> LogOptional<T> logIf(bool bShow, const char *prefix, T value, const char *suffix = "")
+{
+    LogOptional<T> part = {bShow, prefix, value, suffix};
+    return part;
+}
+template<typename T> void logArg(LogRecord &r, const LogOptional<T> &part)
+{
+    if (!part.bShow)
+        return;
+    logArg(r, part.prefix);
+    logArg(r, part.value);
+    logArg(r, part.suffix);
+}
+
+inline void logArgs(LogRecord &) {}
+template<typename T, typename... Rest> void logArgs(LogRecord &r, const T &first, const Rest &...rest)
+{
+    logArg(r, first);
+    logArgs(r, rest...);
+}
+
+template<typename... Args> void logMessage(int level, const Args &...args)
+{
+    LogRecord record(level);
+    logArgs(record, args...);
+}
+
+#define LOG_AT(level, ...) \
+    do { if ((level) >= LOG_MIN_LEVEL && (level) >= logLevel()) logMessage((level), __VA_ARGS__); } while (0)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif /* logger_hpp */
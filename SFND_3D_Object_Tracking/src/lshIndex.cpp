@@ -0,0 +1,220 @@
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <climits>
+#include <opencv2/core/hal/hal.hpp>
+
+#include "lshIndex.hpp"
+#include "bruteForceMatcher.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+LshIndex::LshIndex(int nTables, int keySize, int multiProbeLevel, uint64_t seed)
+    : nTables(max(1, nTables)), keySize(max(1, min(keySize, 32))), multiProbeLevel(max(0, min(multiProbeLevel, 3))), seed(seed)
+{
+}
+
+uint32_t LshIndex::hashKey(const HashTable &table, const uchar *desc) const
+{
+    uint32_t key = 0;
+    for (size_t j = 0; j < table.bytePos.size(); ++j)
+    {
+        if (desc[table.bytePos[j]] & table.bitMask[j])
+            key |= 1u << j;
+    }
+    return key;
+}
+
+void LshIndex::build(const cv::Mat &descriptors)
+{
+    CV_Assert(descriptors.empty() || descriptors.type() == CV_8U);
+    refDesc = descriptors;
+    tables.assign(nTables, HashTable());
+    if (refDesc.empty())
+        return;
+
+    int nBits = refDesc.cols * 8;
+    int keyBits = min(keySize, nBits);
+    cv::RNG rng(seed);
+    vector<int> bits(nBits);
+    vector<pair<uint32_t, int>> entries(refDesc.rows);
+
+    for (auto &table : tables)
+    {
+        // sample distinct bit positions (partial Fisher-Yates shuffle)
+        iota(bits.begin(), bits.end(), 0);
+        table.bytePos.resize(keyBits);
+        table.bitMask.resize(keyBits);
+        for (int j = 0; j < keyBits; ++j)
+        {
+            swap(bits[j], bits[j + rng.uniform(0, nBits - j)]);
+            table.bytePos[j] = bits[j] / 8;
+            table.bitMask[j] = (uchar)(1 << (bits[j] % 8));
+        }
+
+        for (int i = 0; i < refDesc.rows; ++i)
+            entries[i] = make_pair(hashKey(table, refDesc.ptr(i)), i);
+        sort(entries.begin(), entries.end());
+
+        table.keys.resize(entries.size());
+        table.ids.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            table.keys[i] = entries[i].first;
+            table.ids[i] = entries[i].second;
+        }
+
+        // short keys are looked up directly instead of by binary search
+        if (keyBits <= kMaxDirectKeyBits)
+        {
+            table.bucketStart.assign((1 << keyBits) + 1, 0);
+            for (uint32_t key : table.keys)
+                ++table.bucketStart[key + 1];
+            partial_sum(table.bucketStart.begin(), table.bucketStart.end(), table.bucketStart.begin());
+        }
+    }
+
+    // all key flips with up to multiProbeLevel bits, ordered by the number of flipped bits
+    probeMasks.assign(1, 0u);
+    size_t levelBegin = 0;
+    for (int level = 1; level <= multiProbeLevel; ++level)
+    {
+        size_t levelEnd = probeMasks.size();
+        for (size_t m = levelBegin; m < levelEnd; ++m)
+        {
+            // extend each mask by one bit above its highest set bit, so every combination is generated once
+            int nextBit = probeMasks[m] == 0 ? 0 : 32 - __builtin_clz(probeMasks[m]);
+            for (int bit = nextBit; bit < keyBits; ++bit)
+                probeMasks.push_back(probeMasks[m] | (1u << bit));
+        }
+        levelBegin = levelEnd;
+    }
+}
+
+void LshIndex::knnMatch(const cv::Mat &descSource, std::vector<cv::DMatch> &matches, double minDescDistRatio) const
+{
+    matches.clear();
+    if (descSource.empty() || refDesc.empty())
+        return;
+    CV_Assert(descSource.type() == CV_8U && descSource.cols == refDesc.cols);
+
+    // every source block writes its matches to the front of its own slot range, the gaps are closed afterwards
+    const int blockSize = 256;
+    matches.resize(descSource.rows);
+    int nBlocks = (descSource.rows + blockSize - 1) / blockSize;
+    vector<int> blockMatches(nBlocks, 0);
+
+    cv::parallel_for_(cv::Range(0, nBlocks), [&](const cv::Range &range) {
+        vector<int> visited(refDesc.rows, -1); // last query which checked a reference descriptor
+        for (int b = range.start; b < range.end; ++b)
+        {
+            int qBegin = b * blockSize, qEnd = min(descSource.rows, qBegin + blockSize);
+            cv::DMatch *out = &matches[qBegin];
+            int nOut = 0;
+
+            for (int q = qBegin; q < qEnd; ++q)
+            {
+                const uchar *query = descSource.ptr(q);
+                int best1 = INT_MAX, best2 = INT_MAX, bestIdx = -1;
+
+                for (const auto &table : tables)
+                {
+                    uint32_t key = hashKey(table, query);
+                    for (uint32_t mask : probeMasks)
+                    {
+                        int first, last;
+                        if (!table.bucketStart.empty())
+                        {
+                            first = table.bucketStart[key ^ mask];
+                            last = table.bucketStart[(key ^ mask) + 1];
+                        }
+                        else
+                        {
+                            auto bucket = equal_range(table.keys.begin(), table.keys.end(), key ^ mask);
+                            first = (int)(bucket.first - table.keys.begin());
+                            last = (int)(bucket.second - table.keys.begin());
+                        }
+
+                        for (int e = first; e < last; ++e)
+                        {
+                            int r = table.ids[e];
+                            if (visited[r] == q)
+                                continue;
+                            visited[r] = q;
+
+                            int d = cv::hal::normHamming(query, refDesc.ptr(r), refDesc.cols);
+                            if (d < best1 || (d == best1 && r < bestIdx))
+                            {
+                                best2 = best1;
+                                best1 = d;
+                                bestIdx = r;
+                            }
+                            else if (d < best2)
+                                best2 = d;
+                        }
+                    }
+                }
+
+                if (bestIdx < 0)
+                    continue;
+                // a single candidate passes the ratio test, as in the brute-force kernels and guided matching
+                if (minDescDistRatio > 0 && best2 != INT_MAX && !((float)best1 / (float)best2 < minDescDistRatio))
+                    continue;
+                out[nOut++] = cv::DMatch(q, bestIdx, 0, (float)best1);
+            }
+            blockMatches[b] = nOut;
+        }
+    });
+
+    int nMatches = 0;
+    for (int b = 0; b < nBlocks; ++b)
+    {
+        for (int i = 0; i < blockMatches[b]; ++i)
+            matches[nMatches++] = matches[b * blockSize + i];
+    }
+    matches.resize(nMatches);
+}
+
+void benchmarkLshIndex(const cv::Mat &descSource, const cv::Mat &descRef, std::string descriptorName, double minDescDistRatio,
+                       int nTables, int keySize, int multiProbeLevel)
+{
+    // exhaustive reference
+    vector<cv::DMatch> bfMatches;
+    double tBF = (double)cv::getTickCount();
+    matchHammingBF(descSource, descRef, bfMatches, minDescDistRatio);
+    tBF = ((double)cv::getTickCount() - tBF) / cv::getTickFrequency();
+
+    LshIndex index(nTables, keySize, multiProbeLevel);
+    double tBuild = (double)cv::getTickCount();
+    index.build(descRef);
+    tBuild = ((double)cv::getTickCount() - tBuild) / cv::getTickFrequency();
+
+    vector<cv::DMatch> lshMatches;
+    double tQuery = (double)cv::getTickCount();
+    index.knnMatch(descSource, lshMatches, minDescDistRatio);
+    tQuery = ((double)cv::getTickCount() - tQuery) / cv::getTickFrequency();
+
+    // both lists are sorted by queryIdx
+    int nFound = 0;
+    for (size_t i = 0, j = 0; i < bfMatches.size() && j < lshMatches.size();)
+    {
+        if (bfMatches[i].queryIdx < lshMatches[j].queryIdx)
+            ++i;
+        else if (bfMatches[i].queryIdx > lshMatches[j].queryIdx)
+            ++j;
+        else
+        {
+            nFound += bfMatches[i].trainIdx == lshMatches[j].trainIdx;
+            ++i;
+            ++j;
+        }
+    }
+    double recall = bfMatches.empty() ? 1.0 : (double)nFound / bfMatches.size();
+
+    LOG_INFO(descriptorName, " LSH benchmark (", nTables, " tables, ", keySize, " bit keys, probe level ",
+             multiProbeLevel, "): build ", 1000 * tBuild, " ms, query ", 1000 * tQuery, " ms, brute force ",
+             1000 * tBF, " ms, recall ", 100 * recall, " % (", nFound, "/", bfMatches.size(), "), ",
+             lshMatches.size(), " LSH matches");
+}
@@ -0,0 +1,51 @@
+#ifndef lshIndex_hpp
+#define lshIndex_hpp
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+// Multi-probe locality sensitive hashing index for binary descriptors (one CV_8U row per keypoint). Every hash table
+// keys a descriptor by keySize randomly sampled bits; a query visits its own bucket plus all buckets whose key differs
+// in up to multiProbeLevel bits, and the candidates found in any table are ranked by their exact Hamming distance.
+class LshIndex {
+public:
+    LshIndex(int nTables = 8, int keySize = 12, int multiProbeLevel = 1, uint64_t seed = 0x1234);
+
+    // index the reference descriptors; the matrix is referenced, not copied, and must stay unchanged while in use
+    void build(const cv::Mat &descriptors);
+    bool empty() const { return refDesc.empty(); }
+    const cv::Mat &descriptors() const { return refDesc; }
+
+    // best match per source descriptor with the same ratio test as the brute-force matchers (minDescDistRatio <= 0
+    // returns every nearest neighbor found, a query whose buckets hold a single candidate keeps it); queryIdx refers to
+    // descSource and trainIdx to the indexed descriptors
+    void knnMatch(const cv::Mat &descSource, std::vector<cv::DMatch> &matches, double minDescDistRatio) const;
+
+private:
+    struct HashTable {
+        std::vector<int> bytePos;       // sampled bit j is bit bitMask[j] of descriptor byte bytePos[j]
+        std::vector<uchar> bitMask;
+        std::vector<uint32_t> keys;     // bucket keys, sorted; entries with equal keys form one bucket
+        std::vector<int> ids;           // reference descriptor index for every entry in keys
+        std::vector<int> bucketStart;   // keys up to kMaxDirectKeyBits: entries of bucket k are [bucketStart[k], bucketStart[k+1])
+    };
+
+    static const int kMaxDirectKeyBits = 16;
+
+    uint32_t hashKey(const HashTable &table, const uchar *desc) const;
+
+    int nTables, keySize, multiProbeLevel;
+    uint64_t seed;
+    cv::Mat refDesc;
+    std::vector<HashTable> tables;
+    std::vector<uint32_t> probeMasks; // key flips visited per table, starting with 0 (the query's own bucket)
+};
+
+// Matches descSource against descRef with LshIndex and with exhaustive Hamming search, and prints build and query
+// times together with the recall of the brute-force matches (after the ratio test)
+void benchmarkLshIndex(const cv::Mat &descSource, const cv::Mat &descRef, std::string descriptorName, double minDescDistRatio,
+                       int nTables = 8, int keySize = 12, int multiProbeLevel = 1);
+
+#endif /* lshIndex_hpp */
@@ -0,0 +1,92 @@
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "matPool.hpp"
+
+using namespace std;
+
+MatPool::MatPool(int maxFreePerKey) : maxFreePerKey(maxFreePerKey), nAcquired(0), nAllocated(0)
+{
+}
+
+cv::Mat MatPool::acquire(int rows, int cols, int type)
+{
+    ++nAcquired;
+    for (auto &bucket : buckets)
+    {
+        if (bucket.rows == rows && bucket.cols == cols && bucket.type == type && !bucket.free.empty())
+        {
+            cv::Mat img = bucket.free.back();
+            bucket.free.pop_back();
+            return img;
+        }
+    }
+    ++nAllocated;
+    return cv::Mat(rows, cols, type);
+}
+
+void MatPool::release(cv::Mat &img)
+{
+    // views into other buffers and buffers still referenced elsewhere (e.g. a gray image which is the camera image)
+    // must not be handed out again
+    if (img.empty() || img.dims != 2 || img.isSubmatrix() || !img.isContinuous() || !img.u || img.u->refcount != 1)
+    {
+        img.release();
+        return;
+    }
+
+    Bucket *target = nullptr;
+    for (auto &bucket : buckets)
+    {
+        if (bucket.rows == img.rows && bucket.cols == img.cols && bucket.type == img.type())
+        {
+            target = &bucket;
+            break;
+        }
+    }
+    if (!target)
+    {
+        Bucket bucket;
+        bucket.rows = img.rows;
+        bucket.cols = img.cols;
+        bucket.type = img.type();
+        buckets.push_back(bucket);
+        target = &buckets.back();
+    }
+    if ((int)target->free.size() < maxFreePerKey)
+        target->free.push_back(img);
+    img.release();
+}
+
+void MatPool::retire(DataFrame &frame)
+{
+    // the cache goes first, its gray image may share the camera image
+    frame.imgCache.release(*this);
+    release(frame.cameraImg);
+    release(frame.descriptors);
+}
+
+size_t MatPool::bytesFree() const
+{
+    size_t bytes = 0;
+    for (const auto &bucket : buckets)
+        bytes += bucket.free.size() * (size_t)bucket.rows * bucket.cols * CV_ELEM_SIZE(bucket.type);
+    return bytes;
+}
+
+bool pageFaultCount(long &minor, long &major)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        minor = usage.ru_minflt;
+        major = usage.ru_majflt;
+        return true;
+    }
+#endif
+    minor = major = 0;
+    return false;
+}
@@ -0,0 +1,39 @@
+#ifndef matPool_hpp
+#define matPool_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+// Pool of image buffers keyed by size and type. Buffers of a retired frame are handed back instead of being freed, and
+// the next frame of the same resolution is served from them, so in steady state the pipeline neither maps new pages
+// for its images nor calls the allocator for them.
+class MatPool {
+public:
+    explicit MatPool(int maxFreePerKey = 4);
+
+    cv::Mat acquire(int rows, int cols, int type); // uninitialized buffer, reused when one of this size and type is free
+    cv::Mat acquire(cv::Size size, int type) { return acquire(size.height, size.width, type); }
+    void release(cv::Mat &img); // takes the buffer back if img is its only owner; img is empty afterwards
+    void retire(DataFrame &frame); // release the camera image, descriptors and cached images of a frame leaving the buffer
+
+    long acquisitions() const { return nAcquired; }
+    long allocations() const { return nAllocated; } // acquisitions which could not be served from the pool
+    size_t bytesFree() const;
+    void resetStats() { nAcquired = nAllocated = 0; }
+
+private:
+    struct Bucket {
+        int rows, cols, type;
+        std::vector<cv::Mat> free;
+    };
+    std::vector<Bucket> buckets; // few distinct keys per pipeline, a linear scan is fastest
+    int maxFreePerKey;
+    long nAcquired, nAllocated;
+};
+
+// Minor and major page faults of the process since its start; false where getrusage is not available
+bool pageFaultCount(long &minor, long &major);
+
+#endif /* matPool_hpp */
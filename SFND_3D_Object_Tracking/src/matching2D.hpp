@@ -28,8 +28,19 @@ void detKeypointsORB(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bV
 void detKeypointsAKAZE(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
 
 void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis=false);
+cv::Ptr<cv::DescriptorExtractor> createDescriptorExtractor(std::string descriptorType);
 void descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType);
+void descKeypointsParallel(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType, int nChunks=0);
+void quantizeDescriptors(const cv::Mat &descriptors, cv::Mat &descQuantized, const cv::PCA *pca=nullptr, double scale=1.0, double offset=0.0);
+void trainDescriptorPCA(const cv::Mat &samples, int nComponents, std::string fileName);
+bool loadDescriptorPCA(std::string fileName, cv::PCA &pca, double &scale, double &offset);
 void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
-                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType);
+                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType,
+                      bool crossCheck=false);
+void matchDescriptorsGuided(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+                            std::vector<cv::DMatch> &matches, std::string descriptorType, std::string selectorType,
+                            float searchRadius, const std::vector<cv::Point2f> &kptShifts=std::vector<cv::Point2f>());
+void benchmarkGuidedMatching(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+                             std::string descriptorType, std::string selectorType, float searchRadius, const std::vector<cv::Point2f> &kptShifts);
 
 #endif /* matching2D_hpp */
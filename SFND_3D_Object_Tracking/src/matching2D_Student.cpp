@@ -1,29 +1,69 @@
 #include <numeric>
+#include <algorithm>
+#include <opencv2/core/hal/hal.hpp>
 #include "matching2D.hpp"
+#include "bruteForceMatcher.hpp"
+#include "lshIndex.hpp"
+#include "stageTimer.hpp"
+#include "traceEvents.hpp"
+#include "logger.hpp"
 
 using namespace std;
 
 // Find best matches for keypoints in two camera images based on several matching methods
+// (crossCheck keeps mutual nearest neighbors only; MAT_SIMD fuses it into the kernel, MAT_LSH does not support it)
 void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
-                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType)
+                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType,
+                      bool crossCheck)
 {
+    ScopedStageTimer timer(STAGE_HISTOGRAM("matchDescriptors"));
     // configure matcher
-    bool crossCheck = false;
     cv::Ptr<cv::DescriptorMatcher> matcher;
 
+    if (matcherType == "MAT_SIMD" && descSource.type() == CV_8U && descRef.type() == CV_8U)
+    { // brute force in Hamming space (or squared L2 for quantized float descriptors) with the ratio test fused into the kernel
+
+        double minDescDistRatio = (selectorType == "SEL_KNN") ? 0.8 : 0.0;
+        if (descriptorType == "DES_BINARY")
+            matchHammingBF(descSource, descRef, matches, minDescDistRatio, crossCheck);
+        else
+            matchL2SqrBF(descSource, descRef, matches, minDescDistRatio, crossCheck);
+        double t = timer.elapsed();
+        LOG_DEBUG(" (", hammingKernelName(), (descriptorType == "DES_BINARY" ? "" : " L2"), (crossCheck ? ", mutual" : ""),
+                  ") with n=", matches.size(), " matches in ", 1000 * t / 1.0, " ms");
+        LOG_DEBUG("# matched keypoints size = ", matches.size());
+        return;
+    }
+
+    if (matcherType == "MAT_LSH" && descriptorType == "DES_BINARY" && descSource.type() == CV_8U && descRef.type() == CV_8U)
+    { // approximate search in Hamming space with a multi-probe LSH index on the reference descriptors
+
+        int nTables = 8, keySize = 12, multiProbeLevel = 1;
+        double minDescDistRatio = (selectorType == "SEL_KNN") ? 0.8 : 0.0;
+        LshIndex index(nTables, keySize, multiProbeLevel);
+        index.build(descRef);
+        index.knnMatch(descSource, matches, minDescDistRatio);
+        double t = timer.elapsed();
+        LOG_DEBUG(" (LSH) with n=", matches.size(), " matches in ", 1000 * t / 1.0, " ms");
+        LOG_DEBUG("# matched keypoints size = ", matches.size());
+        return;
+    }
 
+    // FLANN works on float descriptors; convert copies so the descriptors stored in the data frames stay untouched
+    cv::Mat descSourceF = descSource, descRefF = descRef;
 
-    if (matcherType.compare("MAT_BF") == 0)
+    if (matcherType.compare("MAT_BF") == 0 || matcherType == "MAT_SIMD" || matcherType == "MAT_LSH")
     {
         int normType = (descriptorType == "DES_BINARY") ? cv::NORM_HAMMING : cv::NORM_L2;
 
-        matcher = cv::BFMatcher::create(normType, crossCheck);
+        // BFMatcher can only cross-check single nearest neighbors, k=2 is cross-checked below
+        matcher = cv::BFMatcher::create(normType, crossCheck && selectorType == "SEL_NN");
     }
     else{
-        if (descSource.type() != CV_32F || descRef.type() != CV_32F){
-            descSource.convertTo(descSource, CV_32F);
-            descRef.convertTo(descRef, CV_32F);
-        }
+        if (descSource.type() != CV_32F)
+            descSource.convertTo(descSourceF, CV_32F);
+        if (descRef.type() != CV_32F)
+            descRef.convertTo(descRefF, CV_32F);
         matcher = cv::FlannBasedMatcher::create();
     }
 
@@ -32,15 +72,14 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
     if (selectorType.compare("SEL_NN") == 0)
     { // nearest neighbor (best match)
 
-        matcher->match(descSource, descRef, matches); // Finds the best match for each descriptor in desc1
+        matcher->match(descSourceF, descRefF, matches); // Finds the best match for each descriptor in desc1
     }
     else if (selectorType == "SEL_KNN")
     { // k nearest neighbors (k=2)
 
-        auto t = static_cast<double>(cv::getTickCount());
         vector<vector<cv::DMatch>> knn_matches;
-        matcher->knnMatch(descSource, descRef, knn_matches, 2); // finds the 2 best matches
-        t = (static_cast<double>(cv::getTickCount()) - t) / cv::getTickFrequency();
+        matcher->knnMatch(descSourceF, descRefF, knn_matches, 2); // finds the 2 best matches
+        double t = timer.elapsed();
 
         // filter matches using descriptor distance ratio test
         double minDescDistRatio = 0.8;
@@ -49,20 +88,218 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
             if (knn_match[0].distance / knn_match[1].distance < minDescDistRatio )
                 matches.push_back(knn_match[0]);
         }
-        cout << " (KNN) with n=" << matches.size() << " matches in " << 1000 * t / 1.0 << " ms" << endl;
+        LOG_DEBUG(" (KNN) with n=", matches.size(), " matches in ", 1000 * t / 1.0, " ms");
 
 //        cout << "# keypoints removed = " << knn_matches.size() - matches.size() << endl;
 
     }
-    cout << "# matched keypoints size = " << matches.size() << endl;
 
+    if (crossCheck && !(selectorType == "SEL_NN" && matcherType != "MAT_FLANN"))
+    { // mutual check by matching in the opposite direction, which costs a second search
+
+        vector<cv::DMatch> reverseMatches;
+        matcher->match(descRefF, descSourceF, reverseMatches);
+        vector<int> bestSource(descRefF.rows, -1);
+        for (const auto &match : reverseMatches)
+            bestSource[match.queryIdx] = match.trainIdx;
+        matches.erase(remove_if(matches.begin(), matches.end(),
+                                [&bestSource](const cv::DMatch &match) { return bestSource[match.trainIdx] != match.queryIdx; }),
+                      matches.end());
+    }
+    LOG_DEBUG("# matched keypoints size = ", matches.size());
+
+}
+
+// Store float descriptors as saturated uint8 (value * scale + offset), after projecting them onto the principal components
+// if a PCA is given. OpenCV's SIFT already scales its descriptor to integers in [0, 255], so scale 1 and offset 0 without
+// PCA are lossless. One scale for all components keeps the L2 geometry of the projected descriptors.
+void quantizeDescriptors(const cv::Mat &descriptors, cv::Mat &descQuantized, const cv::PCA *pca, double scale, double offset)
+{
+    TRACE_FUNCTION();
+    cv::Mat desc = descriptors;
+    if (desc.type() != CV_32F)
+        descriptors.convertTo(desc, CV_32F);
+    if (pca != nullptr && !pca->eigenvectors.empty())
+        desc = pca->project(desc);
+    desc.convertTo(descQuantized, CV_8U, scale, offset);
+}
+
+// Train the PCA for quantizeDescriptors offline on sample descriptors (one per row) and store it together with the scale
+// and offset which map the projected samples to [0, 255]
+void trainDescriptorPCA(const cv::Mat &samples, int nComponents, std::string fileName)
+{
+    TRACE_FUNCTION();
+    cv::Mat samplesF = samples;
+    if (samplesF.type() != CV_32F)
+        samples.convertTo(samplesF, CV_32F);
+    cv::PCA pca(samplesF, cv::Mat(), cv::PCA::DATA_AS_ROW, nComponents);
+
+    double minVal, maxVal;
+    cv::minMaxLoc(pca.project(samplesF), &minVal, &maxVal);
+    double scale = maxVal > minVal ? 255.0 / (maxVal - minVal) : 1.0;
+    double offset = -minVal * scale;
+
+    cv::FileStorage fs(fileName, cv::FileStorage::WRITE);
+    fs << "mean" << pca.mean << "eigenvectors" << pca.eigenvectors << "eigenvalues" << pca.eigenvalues;
+    fs << "scale" << scale << "offset" << offset;
+    LOG_INFO("Descriptor PCA with ", pca.eigenvectors.rows, " of ", samplesF.cols, " components written to ", fileName);
+}
+
+bool loadDescriptorPCA(std::string fileName, cv::PCA &pca, double &scale, double &offset)
+{
+    TRACE_FUNCTION();
+    cv::FileStorage fs(fileName, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        LOG_ERROR("Cannot open descriptor PCA file ", fileName);
+        return false;
+    }
+    fs["mean"] >> pca.mean;
+    fs["eigenvectors"] >> pca.eigenvectors;
+    fs["eigenvalues"] >> pca.eigenvalues;
+    fs["scale"] >> scale;
+    fs["offset"] >> offset;
+    if (pca.mean.empty() || pca.eigenvectors.empty())
+    {
+        LOG_ERROR("Descriptor PCA file ", fileName, " has no mean or eigenvectors");
+        return false;
+    }
+    return true;
+}
+
+// Guided matching: reference keypoints are binned into a grid with cells of searchRadius pixels, and every source
+// keypoint is only compared with reference keypoints within searchRadius of its position shifted by kptShifts (the
+// predicted image motion per source keypoint; empty means no motion). With SEL_KNN the ratio test is applied among
+// the candidates of the search window; a single candidate in the window is accepted.
+void matchDescriptorsGuided(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+                            std::vector<cv::DMatch> &matches, std::string descriptorType, std::string selectorType,
+                            float searchRadius, const std::vector<cv::Point2f> &kptShifts)
+{
+    ScopedStageTimer timer(STAGE_HISTOGRAM("matchDescriptorsGuided"));
+    matches.clear();
+    if (kPtsSource.empty() || kPtsRef.empty() || descSource.empty() || descRef.empty())
+        return;
+    CV_Assert(descSource.type() == descRef.type() && descSource.cols == descRef.cols);
+
+
+    // bin reference keypoints into the grid (cell lists stored back to back, cellStart[c] points to the first entry)
+    float minX = kPtsRef[0].pt.x, minY = kPtsRef[0].pt.y, maxX = minX, maxY = minY;
+    for (const auto &kpt : kPtsRef)
+    {
+        minX = min(minX, kpt.pt.x);
+        minY = min(minY, kpt.pt.y);
+        maxX = max(maxX, kpt.pt.x);
+        maxY = max(maxY, kpt.pt.y);
+    }
+    float cellSize = max(searchRadius, 1.0f);
+    int nCellsX = (int)((maxX - minX) / cellSize) + 1, nCellsY = (int)((maxY - minY) / cellSize) + 1;
+    vector<int> cellStart(nCellsX * nCellsY + 1, 0), cellIds(kPtsRef.size()), kptCell(kPtsRef.size());
+    for (size_t i = 0; i < kPtsRef.size(); ++i)
+    {
+        int cx = (int)((kPtsRef[i].pt.x - minX) / cellSize), cy = (int)((kPtsRef[i].pt.y - minY) / cellSize);
+        kptCell[i] = cy * nCellsX + cx;
+        ++cellStart[kptCell[i] + 1];
+    }
+    partial_sum(cellStart.begin(), cellStart.end(), cellStart.begin());
+    vector<int> cellFill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < kPtsRef.size(); ++i)
+        cellIds[cellFill[kptCell[i]]++] = (int)i;
+
+    bool bBinary = descriptorType == "DES_BINARY" && descSource.type() == CV_8U;
+    bool bKNN = selectorType == "SEL_KNN";
+    double minDescDistRatio = 0.8;
+    float radiusSq = searchRadius * searchRadius;
+    cv::Mat descSourceF = descSource, descRefF = descRef;
+    if (!bBinary && descSource.type() != CV_32F)
+    {
+        descSource.convertTo(descSourceF, CV_32F);
+        descRef.convertTo(descRefF, CV_32F);
+    }
+
+    for (size_t q = 0; q < kPtsSource.size(); ++q)
+    {
+        cv::Point2f pos = kPtsSource[q].pt;
+        if (!kptShifts.empty())
+            pos += kptShifts[q];
+
+        int cx0 = max(0, (int)floor((pos.x - searchRadius - minX) / cellSize)), cx1 = min(nCellsX - 1, (int)floor((pos.x + searchRadius - minX) / cellSize));
+        int cy0 = max(0, (int)floor((pos.y - searchRadius - minY) / cellSize)), cy1 = min(nCellsY - 1, (int)floor((pos.y + searchRadius - minY) / cellSize));
+
+        float best1 = numeric_limits<float>::max(), best2 = best1;
+        int bestIdx = -1;
+        for (int cy = cy0; cy <= cy1; ++cy)
+        {
+            for (int cx = cx0; cx <= cx1; ++cx)
+            {
+                int cell = cy * nCellsX + cx;
+                for (int e = cellStart[cell]; e < cellStart[cell + 1]; ++e)
+                {
+                    int r = cellIds[e];
+                    cv::Point2f diff = kPtsRef[r].pt - pos;
+                    if (diff.x * diff.x + diff.y * diff.y > radiusSq)
+                        continue;
+
+                    float d;
+                    if (bBinary)
+                        d = (float)cv::hal::normHamming(descSource.ptr((int)q), descRef.ptr(r), descSource.cols);
+                    else
+                        d = sqrt(cv::hal::normL2Sqr_(descSourceF.ptr<float>((int)q), descRefF.ptr<float>(r), descSourceF.cols));
+
+                    if (d < best1 || (d == best1 && r < bestIdx))
+                    {
+                        best2 = best1;
+                        best1 = d;
+                        bestIdx = r;
+                    }
+                    else if (d < best2)
+                        best2 = d;
+                }
+            }
+        }
+
+        if (bestIdx < 0)
+            continue;
+        if (bKNN && best2 != numeric_limits<float>::max() && !(best1 / best2 < minDescDistRatio))
+            continue;
+        matches.push_back(cv::DMatch((int)q, bestIdx, 0, best1));
+    }
+
+    double t = timer.elapsed();
+    LOG_DEBUG(" (guided, r=", searchRadius, " px) with n=", matches.size(), " matches in ", 1000 * t / 1.0, " ms");
 }
+
+// Compares guided matching with exhaustive brute-force matching (ratio test as configured by selectorType) and prints
+// the recall of the brute-force matches, the number of guided matches outside of them, and both run times
+void benchmarkGuidedMatching(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+                             std::string descriptorType, std::string selectorType, float searchRadius, const std::vector<cv::Point2f> &kptShifts)
+{
+    TRACE_FUNCTION();
+    vector<cv::DMatch> bfMatches, guidedMatches;
+    auto tBF = static_cast<double>(cv::getTickCount());
+    matchDescriptors(kPtsSource, kPtsRef, descSource, descRef, bfMatches, descriptorType, "MAT_BF", selectorType);
+    tBF = (static_cast<double>(cv::getTickCount()) - tBF) / cv::getTickFrequency();
+
+    auto tGuided = static_cast<double>(cv::getTickCount());
+    matchDescriptorsGuided(kPtsSource, kPtsRef, descSource, descRef, guidedMatches, descriptorType, selectorType, searchRadius, kptShifts);
+    tGuided = (static_cast<double>(cv::getTickCount()) - tGuided) / cv::getTickFrequency();
+
+    vector<int> bfPartner(kPtsSource.size(), -1);
+    for (const auto &match : bfMatches)
+        bfPartner[match.queryIdx] = match.trainIdx;
+    int nFound = 0;
+    for (const auto &match : guidedMatches)
+        nFound += bfPartner[match.queryIdx] == match.trainIdx;
+
+    LOG_INFO("Guided matching benchmark: recall ", (bfMatches.empty() ? 100.0 : 100.0 * nFound / bfMatches.size()), " % (",
+             nFound, "/", bfMatches.size(), "), ", guidedMatches.size() - nFound, " matches not found by brute force, ",
+             "brute force ", 1000 * tBF, " ms, guided ", 1000 * tGuided, " ms");
+}
+
 //// -> BRIEF, ORB, FREAK, AKAZE, SIFT
 
-// Use one of several types of state-of-art descriptors to uniquely identify keypoints
-void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType)
+// Create a descriptor extractor of the given type, configured with the parameters used throughout this project
+cv::Ptr<cv::DescriptorExtractor> createDescriptorExtractor(std::string descriptorType)
 {
-    // select appropriate descriptor
     cv::Ptr<cv::DescriptorExtractor> extractor;
     if (descriptorType.compare("BRISK") == 0)
     {
@@ -93,17 +330,121 @@ void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descr
     {
         extractor = cv::SIFT::create();
     }
+    return extractor;
+}
+
+// Use one of several types of state-of-art descriptors to uniquely identify keypoints
+void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType)
+{
+    ScopedStageTimer timer(STAGE_HISTOGRAM("descKeypoints"));
+    // select appropriate descriptor
+    cv::Ptr<cv::DescriptorExtractor> extractor = createDescriptorExtractor(descriptorType);
 
     // perform feature description
-    double t = (double)cv::getTickCount();
     extractor->compute(img, keypoints, descriptors);
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << descriptorType << " descriptor extraction in " << 1000 * t / 1.0 << " ms" << endl;
+    double t = timer.elapsed();
+    LOG_DEBUG(descriptorType, " descriptor extraction in ", 1000 * t / 1.0, " ms");
+}
+
+// SIFT packs octave, layer and scale into KeyPoint::octave; the octave is the signed lowest byte
+static int unpackOctave(const cv::KeyPoint &kpt)
+{
+    int octave = kpt.octave & 255;
+    return octave < 128 ? octave : (-128 | octave);
+}
+
+// Same as descKeypoints, but the keypoints are split into chunks which are described concurrently into preallocated
+// rows of a single descriptor matrix. Extractors may drop keypoints close to the image border, so each chunk reports
+// how many keypoints survived and the rows are compacted afterwards. Keypoints and descriptors are bit-identical to
+// the serial path.
+void descKeypointsParallel(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType, int nChunks)
+{
+    ScopedStageTimer timer(STAGE_HISTOGRAM("descKeypointsParallel"));
+    if (nChunks <= 0)
+        nChunks = max(1, cv::getNumThreads());
+    nChunks = min(nChunks, (int)keypoints.size());
+    if (nChunks <= 1)
+    {
+        descKeypoints(keypoints, img, descriptors, descriptorType);
+        return;
+    }
+
+
+    // SIFT builds its scale space starting at the lowest octave of the given keypoints. Chunks without a keypoint in
+    // that octave get a sentinel copy appended (SIFT never drops keypoints), whose row is discarded afterwards.
+    bool bSIFT = descriptorType == "SIFT";
+    int minOctave = 0, minOctaveIdx = 0;
+    for (int i = 0; i < (int)keypoints.size(); ++i)
+    {
+        if (unpackOctave(keypoints[i]) < minOctave)
+        {
+            minOctave = unpackOctave(keypoints[i]);
+            minOctaveIdx = i;
+        }
+    }
+
+    cv::Ptr<cv::DescriptorExtractor> prototype = createDescriptorExtractor(descriptorType);
+    descriptors.create((int)keypoints.size(), prototype->descriptorSize(), prototype->descriptorType());
+
+    vector<vector<cv::KeyPoint>> chunkKpts(nChunks);
+    vector<int> chunkStart(nChunks + 1);
+    for (int c = 0; c <= nChunks; ++c)
+        chunkStart[c] = (int)((size_t)keypoints.size() * c / nChunks);
+
+    cv::parallel_for_(cv::Range(0, nChunks), [&](const cv::Range &range) {
+        for (int c = range.start; c < range.end; ++c)
+        {
+            vector<cv::KeyPoint> &kpts = chunkKpts[c];
+            kpts.assign(keypoints.begin() + chunkStart[c], keypoints.begin() + chunkStart[c + 1]);
+
+            bool bSentinel = false;
+            if (bSIFT && minOctave < 0)
+            {
+                bSentinel = true;
+                for (const auto &kpt : kpts)
+                    bSentinel = bSentinel && unpackOctave(kpt) != minOctave;
+                if (bSentinel)
+                    kpts.push_back(keypoints[minOctaveIdx]);
+            }
+
+            // compute writes in place as long as no keypoint is dropped, otherwise it reallocates and rows are copied
+            cv::Mat chunkDesc = descriptors.rowRange(chunkStart[c], chunkStart[c + 1]);
+            uchar *chunkData = chunkDesc.data;
+            createDescriptorExtractor(descriptorType)->compute(img, kpts, chunkDesc);
+
+            if (bSentinel)
+            {
+                kpts.pop_back();
+                chunkDesc = chunkDesc.rowRange(0, chunkDesc.rows - 1);
+            }
+            if (chunkDesc.data != chunkData && !chunkDesc.empty())
+                chunkDesc.copyTo(descriptors.rowRange(chunkStart[c], chunkStart[c] + chunkDesc.rows));
+        }
+    });
+
+    // compact rows of chunks which lost keypoints at the image border
+    keypoints.clear();
+    int nRows = 0;
+    for (int c = 0; c < nChunks; ++c)
+    {
+        for (int i = 0; i < (int)chunkKpts[c].size(); ++i, ++nRows)
+        {
+            if (nRows != chunkStart[c] + i)
+                memmove(descriptors.ptr(nRows), descriptors.ptr(chunkStart[c] + i), descriptors.cols * descriptors.elemSize());
+        }
+        keypoints.insert(keypoints.end(), chunkKpts[c].begin(), chunkKpts[c].end());
+    }
+    if (nRows < descriptors.rows)
+        descriptors.pop_back(descriptors.rows - nRows);
+
+    double t = timer.elapsed();
+    LOG_DEBUG(descriptorType, " descriptor extraction (", nChunks, " chunks) in ", 1000 * t / 1.0, " ms");
 }
 
 // Detect keypoints in image using the traditional Shi-Thomasi detector
 void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis)
 {
+    ScopedStageTimer timer(STAGE_HISTOGRAM("detKeypointsShiTomasi"));
     // compute detector parameters based on image size
     int blockSize = 4;       //  size of an average block for computing a derivative covariation matrix over each pixel neighborhood
     double maxOverlap = 0.0; // max. permissible overlap between two features in %
@@ -114,7 +455,6 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
     double k = 0.04;
 
     // Apply corner detection
-    double t = (double)cv::getTickCount();
     vector<cv::Point2f> corners;
     cv::goodFeaturesToTrack(img, corners, maxCorners, qualityLevel, minDistance, cv::Mat(), blockSize, false, k);
 
@@ -127,8 +467,8 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
         newKeyPoint.size = blockSize;
         keypoints.push_back(newKeyPoint);
     }
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "Shi-Tomasi detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    double t = timer.elapsed();
+    LOG_DEBUG("Shi-Tomasi detection with n=", keypoints.size(), " keypoints in ", 1000 * t / 1.0, " ms");
 
     // visualize results
     if (bVis)
@@ -143,6 +483,7 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
 }
 
 void detKeypointsHarris(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis) {
+    ScopedStageTimer timer(STAGE_HISTOGRAM("detKeypointsHarris"));
     // Detector parameters
     int blockSize = 2;     // for every pixel, a blockSize × blockSize neighborhood is considered
     int apertureSize = 3;  // aperture parameter for Sobel operator (must be odd)
@@ -150,7 +491,6 @@ void detKeypointsHarris(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis
     double k = 0.04;       // Harris parameter (see equation for details)
 
     // Apply corner detection
-    double t = (double)cv::getTickCount();
 
     for(int r = 0; r < img.rows; r++){
         for(int c = 0; c < img.cols; c++){
@@ -180,8 +520,8 @@ void detKeypointsHarris(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis
             }
         } // eof loop over cols
     } // eof loop over rows
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "Harris detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    double t = timer.elapsed();
+    LOG_DEBUG("Harris detection with n=", keypoints.size(), " keypoints in ", 1000 * t / 1.0, " ms");
 
     // visualize results
     if (bVis)
@@ -196,16 +536,16 @@ void detKeypointsHarris(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis
 }
 
 void detKeypointsFAST(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis) {
+    ScopedStageTimer timer(STAGE_HISTOGRAM("detKeypointsFAST"));
 
     // Apply corner detection
     int threshhold = 10;
     bool nonmaxSuppression = true;
 
     auto fast = cv::FastFeatureDetector::create(threshhold, nonmaxSuppression);
-    double t = (double)cv::getTickCount();
     fast->detect(img, keypoints);
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "FAST with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    double t = timer.elapsed();
+    LOG_DEBUG("FAST with n= ", keypoints.size(), " keypoints in ", 1000 * t / 1.0, " ms");
 
     // visualize results
     if (bVis)
@@ -220,13 +560,13 @@ void detKeypointsFAST(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis)
 }
 
 void detKeypointsBRISK(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis) {
+    ScopedStageTimer timer(STAGE_HISTOGRAM("detKeypointsBRISK"));
     // BRISK detector / descriptor
     cv::Ptr<cv::FeatureDetector> detector = cv::BRISK::create();
 
-    double t = (double)cv::getTickCount();
     detector->detect(img, keypoints);
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "BRISK detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    double t = timer.elapsed();
+    LOG_DEBUG("BRISK detector with n= ", keypoints.size(), " keypoints in ", 1000 * t / 1.0, " ms");
 
     // visualize results
     if (bVis)
@@ -241,13 +581,13 @@ void detKeypointsBRISK(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis)
 }
 
 void detKeypointsSIFT(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis) {
+    ScopedStageTimer timer(STAGE_HISTOGRAM("detKeypointsSIFT"));
     // BRISK detector / descriptor
     auto detector = cv::SIFT::create();
 
-    double t = (double)cv::getTickCount();
     detector->detect(img, keypoints);
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "SIFT detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    double t = timer.elapsed();
+    LOG_DEBUG("SIFT detector with n= ", keypoints.size(), " keypoints in ", 1000 * t / 1.0, " ms");
 
     // visualize results
     if (bVis)
@@ -262,13 +602,13 @@ void detKeypointsSIFT(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis)
 }
 
 void detKeypointsORB(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis) {
+    ScopedStageTimer timer(STAGE_HISTOGRAM("detKeypointsORB"));
 
     auto detector = cv::ORB::create();
 
-    double t = (double)cv::getTickCount();
     detector->detect(img, keypoints);
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "ORB detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    double t = timer.elapsed();
+    LOG_DEBUG("ORB detector with n= ", keypoints.size(), " keypoints in ", 1000 * t / 1.0, " ms");
 
     // visualize results
     if (bVis)
@@ -283,12 +623,12 @@ void detKeypointsORB(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis) {
 }
 
 void detKeypointsAKAZE(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis) {
+    ScopedStageTimer timer(STAGE_HISTOGRAM("detKeypointsAKAZE"));
     auto detector = cv::AKAZE::create();
 
-    double t = (double)cv::getTickCount();
     detector->detect(img, keypoints);
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "AKAZE detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    double t = timer.elapsed();
+    LOG_DEBUG("AKAZE detector with n= ", keypoints.size(), " keypoints in ", 1000 * t / 1.0, " ms");
 
     // visualize results
     if (bVis)
@@ -2,42 +2,162 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <climits>
+#include <memory>
 
 #include <opencv2/dnn.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
 #include "objectDetection2D.hpp"
+#include "boxNMS.hpp"
+#include "traceEvents.hpp"
+#include "logger.hpp"
 
 
 using namespace std;
 
-// detects objects in an image using the YOLO library and a set of pre-trained objects from the COCO database;
-// a set of 80 classes is listed in "coco.names" and pre-trained weights are stored in "yolov3.weights"
-void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThreshold, float nmsThreshold, 
-                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis)
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && (CV_VERSION_MINOR > 5 || (CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 4)))
+#define HAVE_DNN_INT8 // cv::dnn::Net::quantize and import of quantized ONNX models
+#endif
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+#define HAVE_DNN_CPU_FP16 // cv::dnn::DNN_TARGET_CPU_FP16
+#endif
+
+// network input size and the scale and padding of the image on it
+struct InputMapping {
+    cv::Size size;
+    double scaleX, scaleY;
+    int padX, padY;
+};
+
+// loads a Darknet (cfg + weights) or ONNX (weights only) model for the CPU in the given precision: FP32, FP16 (reduced
+// precision target where the OpenCV build offers it), INT8 (an already quantized ONNX model, or the float model
+// quantized here with calibBlob as calibration data)
+static cv::dnn::Net loadDetector(std::string modelConfiguration, std::string modelWeights, std::string precision,
+                                 const cv::Mat &calibBlob)
 {
-    // load class names from file
-    vector<string> classes;
-    ifstream ifs(classesFile.c_str());
-    string line;
-    while (getline(ifs, line)) classes.push_back(line);
-    
-    // load neural network
-    cv::dnn::Net net = cv::dnn::readNetFromDarknet(modelConfiguration, modelWeights);
+    TRACE_FUNCTION();
+    cv::dnn::Net net = cv::dnn::readNet(modelWeights, modelConfiguration);
     net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
     net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
-    
-    // generate 4D blob from input image
-    cv::Mat blob;
-    vector<cv::Mat> netOutput;
+
+    if (precision.compare("FP16") == 0)
+    {
+#ifdef HAVE_DNN_CPU_FP16
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU_FP16);
+#else
+        LOG_WARN("FP16 CPU inference needs OpenCV 4.9 or newer, running FP32");
+#endif
+    }
+    else if (precision.compare("INT8") == 0 && modelWeights.find(".onnx") == string::npos)
+    {
+#ifdef HAVE_DNN_INT8
+        // float input and output, so blob creation and decoding stay the same
+        vector<cv::Mat> calibData(1, calibBlob);
+        net = net.quantize(calibData, CV_32F, CV_32F);
+        net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+#else
+        LOG_WARN("INT8 quantization needs OpenCV 4.5.4 or newer, running FP32");
+#endif
+    }
+    return net;
+}
+
+static bool bOnnxPixelCoords = true; // box coordinates of ONNX models, see setOnnxBoxUnits
+
+void setOnnxBoxUnits(std::string units)
+{
+    bOnnxPixelCoords = units.compare("NORMALIZED") != 0;
+}
+
+// networks are loaded once per process and model, and shared by all frames and benchmarks. The input and NMS buffers
+// belong to the detector and are reused on every frame; like the net, a detector serves one inference at a time.
+struct LoadedDetector {
+    std::string key; // model files and precision
+    cv::dnn::Net net;
+    bool bOnnx;        // rows of the YOLOv5 export layout, see runDetector
+    bool bPixelCoords; // output boxes in input pixels rather than relative to the input
+    double loadTime;   // seconds
+
+    cv::Mat blob;           // network input, overwritten in place while the input size stays the same
+    cv::Mat scaled, padded; // letterbox intermediates
+    BoxNMS nms;
+};
+static vector<unique_ptr<LoadedDetector>> loadedDetectors;
+
+// generate 4D blob from input image into detector.blob; network outputs are relative to the input, mapped back with the
+// scale and padding of the image on the input
+static void makeInputBlob(const cv::Mat &img, cv::Size inputSize, bool bLetterbox, InputMapping &mapping,
+                          LoadedDetector &detector)
+{
+    TRACE_FUNCTION();
     double scalefactor = 1/255.0;
-    cv::Size size = cv::Size(416, 416);
+    cv::Size size = inputSize;
     cv::Scalar mean = cv::Scalar(0,0,0);
     bool swapRB = false;
     bool crop = false;
-    cv::dnn::blobFromImage(img, blob, scalefactor, size, mean, swapRB, crop);
-    
+    mapping.size = size;
+    mapping.scaleX = (double)size.width / img.cols;
+    mapping.scaleY = (double)size.height / img.rows;
+    mapping.padX = mapping.padY = 0;
+    if (bLetterbox)
+    {
+        mapping.scaleX = mapping.scaleY = min(mapping.scaleX, mapping.scaleY);
+        cv::Size scaledSize(cvRound(img.cols * mapping.scaleX), cvRound(img.rows * mapping.scaleY));
+        mapping.padX = (size.width - scaledSize.width) / 2;
+        mapping.padY = (size.height - scaledSize.height) / 2;
+
+        cv::resize(img, detector.scaled, scaledSize, 0, 0, cv::INTER_AREA);
+        cv::copyMakeBorder(detector.scaled, detector.padded, mapping.padY, size.height - scaledSize.height - mapping.padY,
+                           mapping.padX, size.width - scaledSize.width - mapping.padX, cv::BORDER_CONSTANT,
+                           cv::Scalar(127, 127, 127));
+        cv::dnn::blobFromImage(detector.padded, detector.blob, scalefactor, size, mean, swapRB, crop);
+    }
+    else
+        cv::dnn::blobFromImage(img, detector.blob, scalefactor, size, mean, swapRB, crop);
+}
+
+// calibImg, inputSize and bLetterbox give the calibration input when a float model is quantized to INT8 on load
+static LoadedDetector &getDetector(std::string modelConfiguration, std::string modelWeights, std::string precision,
+                                   const cv::Mat &calibImg, cv::Size inputSize, bool bLetterbox)
+{
+    string key = modelConfiguration + "|" + modelWeights + "|" + precision;
+    for (const auto &detector : loadedDetectors)
+        if (detector->key == key)
+            return *detector;
+
+    double t = (double)cv::getTickCount();
+    loadedDetectors.push_back(unique_ptr<LoadedDetector>(new LoadedDetector()));
+    LoadedDetector &detector = *loadedDetectors.back();
+    detector.key = key;
+    if (!calibImg.empty())
+    {
+        InputMapping mapping;
+        makeInputBlob(calibImg, inputSize, bLetterbox, mapping, detector);
+    }
+    detector.net = loadDetector(modelConfiguration, modelWeights, precision, detector.blob);
+    detector.bOnnx = modelConfiguration.empty();
+    detector.bPixelCoords = detector.bOnnx && bOnnxPixelCoords;
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    detector.loadTime = t;
+    LOG_INFO("Loaded ", modelWeights, " (", precision, ", boxes in ", (detector.bPixelCoords ? "pixels" : "normalized"),
+             ") in ", 1000 * t, " ms");
+    return detector;
+}
+
+// Runs the network and decodes its output rows (cx, cy, w, h, objectness, class scores) into boxes, shared by all
+// models, on the input made by makeInputBlob. Darknet outputs one 2D matrix per YOLO layer with coordinates relative to the input and class scores which
+// already include the objectness. The only ONNX layout supported is that of the YOLOv5 export (export.py of
+// ultralytics/yolov5): a single 1 x rows x (5 + classes) output with raw objectness and class scores, in input pixels
+// unless setOnnxBoxUnits says otherwise.
+static void runDetector(LoadedDetector &detector, const InputMapping &mapping, float confThreshold, float nmsThreshold,
+                        std::vector<BoundingBox> &bBoxes)
+{
+    cv::dnn::Net net = detector.net;
+    bool bPixelCoords = detector.bPixelCoords;
+    TRACE_FUNCTION();
     // Get names of output layers
     vector<cv::String> names;
     vector<int> outLayers = net.getUnconnectedOutLayers(); // get  indices of  output layers, i.e.  layers with unconnected outputs
@@ -48,52 +168,104 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
         names[i] = layersNames[outLayers[i] - 1];
     
     // invoke forward propagation through network
-    net.setInput(blob);
+    vector<cv::Mat> netOutput;
+    net.setInput(detector.blob);
     net.forward(netOutput, names);
     
     // Scan through all bounding boxes and keep only the ones with high confidence
-    vector<int> classIds; vector<float> confidences; vector<cv::Rect> boxes;
+    BoxNMS &nms = detector.nms;
+    nms.clear();
     for (size_t i = 0; i < netOutput.size(); ++i)
     {
-        float* data = (float*)netOutput[i].data;
-        for (int j = 0; j < netOutput[i].rows; ++j, data += netOutput[i].cols)
+        cv::Mat output = netOutput[i];
+        if (output.dims > 2)
+            output = output.reshape(1, (int)(output.total() / output.size[output.dims - 1]));
+
+        double unitX = bPixelCoords ? 1.0 : mapping.size.width, unitY = bPixelCoords ? 1.0 : mapping.size.height;
+
+        float* data = (float*)output.data;
+        for (int j = 0; j < output.rows; ++j, data += output.cols)
         {
-            cv::Mat scores = netOutput[i].row(j).colRange(5, netOutput[i].cols);
+            cv::Mat scores = output.row(j).colRange(5, output.cols);
             cv::Point classId;
             double confidence;
             
             // Get the value and location of the maximum score
             cv::minMaxLoc(scores, 0, &confidence, 0, &classId);
+            if (detector.bOnnx)
+                confidence *= data[4];
             if (confidence > confThreshold)
             {
                 cv::Rect box; int cx, cy;
-                cx = (int)(data[0] * img.cols);
-                cy = (int)(data[1] * img.rows);
-                box.width = (int)(data[2] * img.cols);
-                box.height = (int)(data[3] * img.rows);
+                cx = (int)((data[0] * unitX - mapping.padX) / mapping.scaleX);
+                cy = (int)((data[1] * unitY - mapping.padY) / mapping.scaleY);
+                box.width = (int)(data[2] * unitX / mapping.scaleX);
+                box.height = (int)(data[3] * unitY / mapping.scaleY);
                 box.x = cx - box.width/2; // left
                 box.y = cy - box.height/2; // top
                 
-                boxes.push_back(box);
-                classIds.push_back(classId.x);
-                confidences.push_back((float)confidence);
+                nms.add(box, classId.x, (float)confidence);
             }
         }
     }
     
-    // perform non-maxima suppression
-    vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, confidences, confThreshold, nmsThreshold, indices);
-    for(auto it=indices.begin(); it!=indices.end(); ++it) {
-        
-        BoundingBox bBox;
-        bBox.roi = boxes[*it];
-        bBox.classID = classIds[*it];
-        bBox.confidence = confidences[*it];
-        bBox.boxID = (int)bBoxes.size(); // zero-based unique identifier for this bounding box
-        
-        bBoxes.push_back(bBox);
+    // perform class-aware non-maxima suppression
+    double tNms = (double)cv::getTickCount();
+    nms.run(nmsThreshold, bBoxes);
+    tNms = ((double)cv::getTickCount() - tNms) / cv::getTickFrequency();
+    LOG_DEBUG("NMS kept ", bBoxes.size(), " of ", nms.candidateCount(), " candidates in ", 1000 * tNms, " ms");
+}
+
+// reference boxes which a box of the same class overlaps by IoU >= 0.5, and their mean IoU
+static void boxAgreement(const std::vector<BoundingBox> &refBoxes, const std::vector<BoundingBox> &bBoxes, int &nFound,
+                         double &meanIoU)
+{
+    nFound = 0;
+    double sumIoU = 0.0;
+    for (const auto &refBox : refBoxes)
+    {
+        double bestIoU = 0.0;
+        for (const auto &box : bBoxes)
+        {
+            if (box.classID != refBox.classID)
+                continue;
+            double inter = (box.roi & refBox.roi).area();
+            bestIoU = max(bestIoU, inter / (box.roi.area() + refBox.roi.area() - inter));
+        }
+        if (bestIoU >= 0.5)
+        {
+            ++nFound;
+            sumIoU += bestIoU;
+        }
     }
+    meanIoU = nFound > 0 ? sumIoU / nFound : 0.0;
+}
+
+// detects objects in an image using the YOLO library and a set of pre-trained objects from the COCO database;
+// a set of 80 classes is listed in "coco.names" and pre-trained weights are stored in "yolov3.weights"
+void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThreshold, float nmsThreshold, 
+                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis,
+                   cv::Size inputSize, bool bLetterbox, std::string precision, double *inferenceTime)
+{
+    TRACE_FUNCTION();
+    // load class names from file
+    vector<string> classes;
+    ifstream ifs(classesFile.c_str());
+    string line;
+    while (getline(ifs, line)) classes.push_back(line);
+    
+    // load neural network (once per process)
+    LoadedDetector &detector = getDetector(modelConfiguration, modelWeights, precision, img, inputSize, bLetterbox);
+
+    double t = (double)cv::getTickCount();
+    InputMapping mapping;
+    makeInputBlob(img, inputSize, bLetterbox, mapping, detector);
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    double tRun = (double)cv::getTickCount();
+    runDetector(detector, mapping, confThreshold, nmsThreshold, bBoxes);
+    if (inferenceTime)
+        *inferenceTime = t + ((double)cv::getTickCount() - tRun) / cv::getTickFrequency();
     
     // show results
     if(bVis) {
@@ -127,3 +299,157 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
         cv::waitKey(0); // wait for key to be pressed
     }
 }
+
+double sceneChange(ImageCache &prevCache, ImageCache &currCache, const std::vector<BoundingBox> &prevBoxes, int level)
+{
+    TRACE_FUNCTION();
+    const cv::Mat &prevImg = prevCache.pyramid(level + 1)[level];
+    const cv::Mat &currImg = currCache.pyramid(level + 1)[level];
+    CV_Assert(prevImg.size() == currImg.size());
+
+    cv::Mat diff;
+    cv::absdiff(prevImg, currImg, diff);
+    double change = cv::mean(diff)[0];
+
+    double scale = 1.0 / (1 << level);
+    cv::Rect imgRect(0, 0, diff.cols, diff.rows);
+    for (const auto &box : prevBoxes)
+    {
+        cv::Rect roi(cvFloor(box.roi.x * scale), cvFloor(box.roi.y * scale), cvRound(box.roi.width * scale) + 1,
+                     cvRound(box.roi.height * scale) + 1);
+        roi &= imgRect;
+        if (roi.area() > 0)
+            change = max(change, cv::mean(diff(roi))[0]);
+    }
+    return change;
+}
+
+int selectYoloInputSize(std::string policy, const std::vector<cv::Size> &sizes, const std::vector<BoundingBox> &prevBoxes,
+                        cv::Size imgSize, bool bLetterbox, int minObjectHeight, const std::vector<double> &latencies,
+                        double latencyTarget)
+{
+    int best = 0;
+    if (policy.compare("DIST") == 0)
+    {
+        if (prevBoxes.empty())
+            return (int)sizes.size() - 1;
+
+        int minHeight = INT_MAX;
+        for (const auto &box : prevBoxes)
+            minHeight = min(minHeight, box.roi.height);
+        for (best = 0; best < (int)sizes.size() - 1; ++best)
+        {
+            double scale = (double)sizes[best].height / imgSize.height;
+            if (bLetterbox)
+                scale = min(scale, (double)sizes[best].width / imgSize.width);
+            if (minHeight * scale >= minObjectHeight)
+                break;
+        }
+    }
+    else if (policy.compare("LATENCY") == 0)
+    {
+        for (int i = 0; i < (int)sizes.size(); ++i)
+        {
+            if (latencies[i] <= 0.0)
+                return i; // measure the next larger size
+            if (latencies[i] > latencyTarget)
+                break;
+            best = i;
+        }
+    }
+    return best;
+}
+
+void benchmarkYoloInputSizes(cv::Mat &img, const std::vector<cv::Size> &sizes, float confThreshold, float nmsThreshold,
+                             std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights)
+{
+    TRACE_FUNCTION();
+    // reference: the largest input without distortion
+    int refIdx = 0;
+    for (int i = 1; i < (int)sizes.size(); ++i)
+        if (sizes[i].area() > sizes[refIdx].area())
+            refIdx = i;
+    vector<BoundingBox> refBoxes;
+    detectObjects(img, refBoxes, confThreshold, nmsThreshold, basePath, classesFile, modelConfiguration, modelWeights, false,
+                  sizes[refIdx], true);
+
+    for (int letterbox = 0; letterbox < 2; ++letterbox)
+    {
+        for (const auto &size : sizes)
+        {
+            vector<BoundingBox> bBoxes;
+            double t;
+            detectObjects(img, bBoxes, confThreshold, nmsThreshold, basePath, classesFile, modelConfiguration, modelWeights,
+                          false, size, letterbox != 0, "FP32", &t);
+
+            int nFound;
+            double meanIoU;
+            boxAgreement(refBoxes, bBoxes, nFound, meanIoU);
+            LOG_INFO("YOLO ", size.width, "x", size.height, (letterbox ? " letterboxed" : " stretched"), ": ",
+                     1000 * t, " ms, ", bBoxes.size(), " boxes, recall ", nFound, "/", refBoxes.size(),
+                     ", mean IoU ", meanIoU);
+        }
+    }
+}
+
+void benchmarkDetectorPrecision(cv::Mat &img, float confThreshold, float nmsThreshold, std::string modelConfiguration,
+                                std::string modelWeights, std::string int8Model, cv::Size inputSize)
+{
+    TRACE_FUNCTION();
+    vector<int> inputShape = {1, 3, inputSize.height, inputSize.width};
+
+    vector<BoundingBox> refBoxes;
+    const char *precisions[] = {"FP32", "FP16", "INT8"};
+    for (const char *precision : precisions)
+    {
+        bool bOnnx = string(precision) == "INT8" && !int8Model.empty();
+        // loaded on the first benchmarked frame only, later frames report that load
+        LoadedDetector &detector = getDetector(bOnnx ? "" : modelConfiguration, bOnnx ? int8Model : modelWeights, precision,
+                                               img, inputSize, false);
+        double tLoad = detector.loadTime;
+        InputMapping mapping;
+        makeInputBlob(img, inputSize, false, mapping, detector);
+
+        // the first inference initializes the layers and is not timed
+        vector<BoundingBox> bBoxes;
+        runDetector(detector, mapping, confThreshold, nmsThreshold, bBoxes);
+        bBoxes.clear();
+        double t = (double)cv::getTickCount();
+        runDetector(detector, mapping, confThreshold, nmsThreshold, bBoxes);
+        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        size_t weightBytes = 0, blobBytes = 0;
+        detector.net.getMemoryConsumption(inputShape, weightBytes, blobBytes);
+
+        if (refBoxes.empty() && string(precision) == "FP32")
+            refBoxes = bBoxes;
+        int nFound;
+        double meanIoU;
+        boxAgreement(refBoxes, bBoxes, nFound, meanIoU);
+        LOG_INFO("YOLO ", precision, (bOnnx ? " (" + int8Model + ")" : string()), ": load ", 1000 * tLoad, " ms, inference ",
+                 1000 * t, " ms, weights ", weightBytes / (1 << 20), " MB, blobs ", blobBytes / (1 << 20), " MB, ",
+                 bBoxes.size(), " boxes, FP32 boxes found ", nFound, "/", refBoxes.size(), ", mean IoU ", meanIoU);
+    }
+}
+
+void initDetector(std::string modelConfiguration, std::string modelWeights, std::string precision, cv::Size inputSize)
+{
+    TRACE_FUNCTION();
+    if (precision.compare("INT8") == 0 && modelWeights.find(".onnx") == string::npos)
+    {
+        LOG_INFO("INT8 quantization of ", modelWeights, " is calibrated on the first frame, not preloaded");
+        return;
+    }
+    cv::dnn::Net net = getDetector(modelConfiguration, modelWeights, precision, cv::Mat(), inputSize, false).net;
+
+    // the first inference allocates the layer buffers and selects kernels
+    double t = (double)cv::getTickCount();
+    cv::Mat gray(inputSize, CV_8UC3, cv::Scalar(127, 127, 127));
+    cv::Mat blob;
+    cv::dnn::blobFromImage(gray, blob, 1/255.0, inputSize, cv::Scalar(0,0,0), false, false);
+    vector<cv::Mat> netOutput;
+    net.setInput(blob);
+    net.forward(netOutput, net.getUnconnectedOutLayersNames());
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    LOG_INFO("Detector warm-up inference ", inputSize.width, "x", inputSize.height, " in ", 1000 * t, " ms");
+}
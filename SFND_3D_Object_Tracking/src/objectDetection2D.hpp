@@ -3,11 +3,55 @@
 #define objectDetection2D_hpp
 
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include <opencv2/core.hpp>
 
 #include "dataStructures.h"
+#include "imageCache.hpp"
 
+// inputSize: network input (multiples of 32), wide sizes such as 608x192 or 832x256 suit the KITTI aspect ratio;
+// bLetterbox: scale the image uniformly and pad it instead of stretching it to inputSize;
+// precision: FP32, FP16 (reduced precision CPU target, OpenCV 4.9+), INT8 (modelWeights is a quantized ONNX model with an
+// empty modelConfiguration, or the Darknet model is quantized on the frame, OpenCV 4.5.4+; the quantized Darknet model
+// has not been tested); ONNX models must have the output layout of the YOLOv5 export, see setOnnxBoxUnits;
+// inferenceTime: optionally receives the time from blob creation to the final boxes in seconds (without loading the net)
 void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThreshold, float nmsThreshold, 
-                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis);
+                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis,
+                   cv::Size inputSize = cv::Size(416, 416), bool bLetterbox = false, std::string precision = "FP32",
+                   double *inferenceTime = nullptr);
+
+// Box coordinates of ONNX models in the YOLOv5 export layout: PIXELS (input pixels, what the YOLOv5 export writes) or
+// NORMALIZED (relative to the input); Darknet models are always normalized
+void setOnnxBoxUnits(std::string units);
+
+// Loads the detector once for the whole process and runs a warm-up inference at inputSize, so the first frame is not
+// slowed down by loading and layer initialization.
+void initDetector(std::string modelConfiguration, std::string modelWeights, std::string precision, cv::Size inputSize);
+
+// Picks the YOLO input size for the next frame from sizes, which are ordered by increasing cost, and returns its index.
+// DIST: the smallest size at which the smallest box of the previous frame (the farthest object) is still minObjectHeight
+// pixels high on the network input, the largest size without previous boxes;
+// LATENCY: the largest size whose measured latency (latencies in ms, 0 = not measured yet) is within latencyTarget;
+// sizes which have not been measured yet are tried in increasing order
+int selectYoloInputSize(std::string policy, const std::vector<cv::Size> &sizes, const std::vector<BoundingBox> &prevBoxes,
+                        cv::Size imgSize, bool bLetterbox, int minObjectHeight, const std::vector<double> &latencies,
+                        double latencyTarget);
+
+// Runs the detector with every input size (stretched and letterboxed) and prints latency, box count, and recall and mean
+// IoU against the detections of the largest letterboxed size
+void benchmarkYoloInputSizes(cv::Mat &img, const std::vector<cv::Size> &sizes, float confThreshold, float nmsThreshold,
+                             std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights);
+
+// Mean absolute gray value difference between two frames on pyramid level `level` (a few thousand pixels at level 2),
+// taken as the larger of the difference inside the boxes of the previous frame and over the whole image, so objects
+// which move as well as objects which enter the scene are noticed. Used to reuse the previous boxes when nothing changed.
+double sceneChange(ImageCache &prevCache, ImageCache &currCache, const std::vector<BoundingBox> &prevBoxes, int level=2);
+
+// Runs the Darknet model in FP32, FP16 and INT8 (int8Model, e.g. an int8 ONNX export of the same detector, or the
+// Darknet model quantized on img when empty) and prints load time, inference time, memory footprint and how many of the
+// FP32 boxes every precision finds
+void benchmarkDetectorPrecision(cv::Mat &img, float confThreshold, float nmsThreshold, std::string modelConfiguration,
+                                std::string modelWeights, std::string int8Model, cv::Size inputSize = cv::Size(416, 416));
 
 #endif /* objectDetection2D_hpp */
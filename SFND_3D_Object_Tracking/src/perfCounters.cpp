@@ -0,0 +1,149 @@
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perfCounters.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+#ifdef __linux__
+
+static int openCounter(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1; // user-space counts are what the paranoid setting permits by default
+    attr.exclude_hv = 1;
+    attr.inherit = 1; // threads created later, above all OpenCV's worker pool, are counted with the opening thread
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0); // this thread and its children, any CPU, no group
+}
+
+static bool readCounter(int fd, unsigned long long values[3])
+{
+    return fd >= 0 && read(fd, values, 3 * sizeof(unsigned long long)) == (ssize_t)(3 * sizeof(unsigned long long));
+}
+
+#endif
+
+PerfCounters::PerfCounters(bool bEnable) : nOpen(0)
+{
+    for (int i = 0; i < N_COUNTERS; ++i)
+        fds[i] = -1;
+    memset(startValues, 0, sizeof(startValues));
+#ifdef __linux__
+    if (!bEnable)
+        return;
+    // the counters are opened separately rather than as one group, so a PMU with fewer free counters than events
+    // multiplexes them (and the counts are scaled) instead of failing to schedule the whole group
+    fds[CYCLES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[INSTRUCTIONS] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[L1D_MISSES] = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    fds[LLC_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[BRANCH_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    for (int i = 0; i < N_COUNTERS; ++i)
+    {
+        if (fds[i] >= 0)
+        {
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            ++nOpen;
+        }
+    }
+    if (nOpen == 0)
+        LOG_WARN("Performance counters are not available (check /proc/sys/kernel/perf_event_paranoid)");
+#else
+    (void)bEnable;
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (int i = 0; i < N_COUNTERS; ++i)
+        if (fds[i] >= 0)
+            close(fds[i]);
+#endif
+}
+
+void PerfCounters::start()
+{
+#ifdef __linux__
+    // the counters run continuously, a stage is the difference of two reads
+    for (int i = 0; i < N_COUNTERS; ++i)
+        if (!readCounter(fds[i], startValues[i]))
+            memset(startValues[i], 0, sizeof(startValues[i]));
+#endif
+}
+
+void PerfCounters::stop(const std::string &stage, long items, const std::string &itemName)
+{
+    if (nOpen == 0)
+        return;
+
+    Stage *s = nullptr;
+    for (auto &candidate : stages)
+    {
+        if (candidate.name == stage)
+        {
+            s = &candidate;
+            break;
+        }
+    }
+    if (!s)
+    {
+        Stage newStage;
+        newStage.name = stage;
+        newStage.itemName = itemName;
+        newStage.runs = newStage.items = 0;
+        for (int i = 0; i < N_COUNTERS; ++i)
+            newStage.counts[i] = 0.0;
+        stages.push_back(newStage);
+        s = &stages.back();
+    }
+    ++s->runs;
+    s->items += items;
+
+#ifdef __linux__
+    for (int i = 0; i < N_COUNTERS; ++i)
+    {
+        unsigned long long values[3];
+        if (!readCounter(fds[i], values))
+            continue;
+        unsigned long long delta = values[0] - startValues[i][0];
+        unsigned long long enabled = values[1] - startValues[i][1];
+        unsigned long long running = values[2] - startValues[i][2];
+        // scale multiplexed counters up to the time the stage ran
+        s->counts[i] += running > 0 ? (double)delta * enabled / running : 0.0;
+    }
+#endif
+}
+
+void PerfCounters::report() const
+{
+    if (nOpen == 0 || stages.empty())
+        return;
+    cout << "Performance counters (all threads, all frames):" << endl;
+    for (const auto &s : stages)
+    {
+        double perItem = s.items > 0 ? 1.0 / s.items : 0.0;
+        cout << "  " << s.name << ": " << s.runs << " runs, " << s.items << " " << s.itemName << "s, IPC " << fixed << setprecision(2)
+             << (s.counts[CYCLES] > 0 ? s.counts[INSTRUCTIONS] / s.counts[CYCLES] : 0.0) << ", per " << s.itemName << ": "
+             << s.counts[CYCLES] * perItem << " cycles, " << s.counts[L1D_MISSES] * perItem << " L1D misses, "
+             << s.counts[LLC_MISSES] * perItem << " LLC misses, " << s.counts[BRANCH_MISSES] * perItem << " branch misses" << endl;
+        cout.unsetf(ios::floatfield);
+        cout << setprecision(6);
+    }
+}
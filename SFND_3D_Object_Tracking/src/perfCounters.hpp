@@ -0,0 +1,42 @@
+#ifndef perfCounters_hpp
+#define perfCounters_hpp
+
+#include <string>
+#include <vector>
+
+// Hardware performance counters (cycles, instructions, L1 data and last-level cache misses, branch misses) of the
+// constructing thread and all threads it creates afterwards, accumulated per named stage with perf_event_open. Construct
+// it before OpenCV starts its worker pool, so the work of parallel_for_ is counted with the stage; other background
+// threads (logger, trace writer) add their little work to the stages they run in. Only available on Linux, and only
+// where the kernel lets unprivileged processes count their own user-space events (perf_event_paranoid <= 2); elsewhere
+// start() and stop() do nothing.
+class PerfCounters {
+public:
+    enum Counter { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, N_COUNTERS };
+
+    explicit PerfCounters(bool bEnable = true);
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available() const { return nOpen > 0; }
+
+    void start();
+    // adds the counts since start() to the stage; items (lidar points, keypoints, ...) normalize the misses
+    void stop(const std::string &stage, long items, const std::string &itemName);
+
+    void report() const; // IPC and misses per item for every stage, aggregated over all frames
+
+private:
+    struct Stage {
+        std::string name, itemName;
+        long runs, items;
+        double counts[N_COUNTERS];
+    };
+    std::vector<Stage> stages;
+    int fds[N_COUNTERS];
+    int nOpen;
+    unsigned long long startValues[N_COUNTERS][3]; // value, time enabled, time running
+};
+
+#endif /* perfCounters_hpp */
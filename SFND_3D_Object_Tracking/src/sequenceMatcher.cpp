@@ -0,0 +1,118 @@
+
+#include <iostream>
+#include <algorithm>
+
+#include "sequenceMatcher.hpp"
+#include "bruteForceMatcher.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+SequenceMatcher::SequenceMatcher(std::string matcherType, std::string descriptorType, std::string selectorType)
+    : matcherType(matcherType), descriptorType(descriptorType), selectorType(selectorType),
+      minDescDistRatio(selectorType == "SEL_KNN" ? 0.8 : 0.0), indexKind(NO_INDEX), tBuild(0.0), tQuery(0.0)
+{
+}
+
+void SequenceMatcher::matchNext(const cv::Mat &descCurr, std::vector<cv::DMatch> &matches)
+{
+    matches.clear();
+    tQuery = 0.0;
+    if (indexKind != NO_INDEX && !descCurr.empty())
+    {
+        double t = (double)cv::getTickCount();
+        queryIndex(descCurr, matches);
+        tQuery = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        // the current frame provided the queries: restore (previous, current) order and sort by previous keypoint
+        for (auto &match : matches)
+            swap(match.queryIdx, match.trainIdx);
+        sort(matches.begin(), matches.end(), [](const cv::DMatch &a, const cv::DMatch &b) {
+            return a.queryIdx < b.queryIdx || (a.queryIdx == b.queryIdx && a.trainIdx < b.trainIdx);
+        });
+    }
+
+    double t = (double)cv::getTickCount();
+    buildIndex(descCurr);
+    tBuild = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    LOG_DEBUG(" (", matcherType, ", persistent index) with n=", matches.size(), " matches, index build in ",
+              1000 * tBuild, " ms, query in ", 1000 * tQuery, " ms");
+}
+
+void SequenceMatcher::buildIndex(const cv::Mat &descriptors)
+{
+    indexKind = NO_INDEX;
+    cvMatcher.reset();
+    if (descriptors.empty())
+        return;
+
+    bool bBinary = descriptorType == "DES_BINARY" && descriptors.type() == CV_8U;
+    if (matcherType == "MAT_SIMD" && descriptors.type() == CV_8U)
+    {
+        indexedDesc = descriptors; // brute force needs no index beyond the descriptors themselves
+        indexKind = SIMD_INDEX;
+    }
+    else if (matcherType == "MAT_LSH" && bBinary)
+    {
+        indexedDesc = descriptors;
+        lshIndex.build(indexedDesc);
+        indexKind = LSH_INDEX;
+    }
+    else if (matcherType == "MAT_FLANN")
+    {
+        // FLANN works on float descriptors; convert a copy so the frame's descriptors stay untouched
+        if (descriptors.type() != CV_32F)
+            descriptors.convertTo(indexedDesc, CV_32F);
+        else
+            indexedDesc = descriptors;
+        cvMatcher = cv::FlannBasedMatcher::create();
+        cvMatcher->add(vector<cv::Mat>(1, indexedDesc));
+        cvMatcher->train();
+        indexKind = CV_INDEX;
+    }
+    else
+    {
+        indexedDesc = descriptors;
+        cvMatcher = cv::BFMatcher::create(descriptorType == "DES_BINARY" ? cv::NORM_HAMMING : cv::NORM_L2, false);
+        cvMatcher->add(vector<cv::Mat>(1, indexedDesc));
+        cvMatcher->train();
+        indexKind = CV_INDEX;
+    }
+}
+
+void SequenceMatcher::queryIndex(const cv::Mat &descQuery, std::vector<cv::DMatch> &matches)
+{
+    if (indexKind == SIMD_INDEX)
+    {
+        if (descriptorType == "DES_BINARY")
+            matchHammingBF(descQuery, indexedDesc, matches, minDescDistRatio);
+        else
+            matchL2SqrBF(descQuery, indexedDesc, matches, minDescDistRatio);
+        return;
+    }
+    if (indexKind == LSH_INDEX)
+    {
+        lshIndex.knnMatch(descQuery, matches, minDescDistRatio);
+        return;
+    }
+
+    cv::Mat query = descQuery;
+    if (query.type() != indexedDesc.type())
+        descQuery.convertTo(query, indexedDesc.type());
+
+    if (minDescDistRatio > 0)
+    {
+        vector<vector<cv::DMatch>> knnMatches;
+        cvMatcher->knnMatch(query, knnMatches, 2);
+        for (auto &knnMatch : knnMatches)
+        {
+            if (knnMatch.size() == 2 && knnMatch[0].distance / knnMatch[1].distance < minDescDistRatio)
+                matches.push_back(knnMatch[0]);
+        }
+    }
+    else
+    {
+        cvMatcher->match(query, matches);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef sequenceMatcher_hpp
+#define sequenceMatcher_hpp
+
+#include <vector>
+#include <string>
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+#include "lshIndex.hpp"
+
+// Descriptor matcher for a sequence of frames. The search index is built once for the descriptors of every frame and
+// kept until the next frame has been matched against it, instead of building a new index for every frame pair.
+// To reuse the index, the descriptors of the newer frame are the queries; the ratio test therefore rejects ambiguous
+// keypoints of the current frame. Matches keep the convention of matchDescriptors (queryIdx indexes the previous
+// frame, trainIdx the current frame) and are sorted by queryIdx.
+class SequenceMatcher {
+public:
+    // matcherType: MAT_BF, MAT_SIMD, MAT_FLANN or MAT_LSH; descriptorType: DES_BINARY or DES_HOG; selectorType: SEL_NN or SEL_KNN
+    SequenceMatcher(std::string matcherType, std::string descriptorType, std::string selectorType);
+
+    // match the descriptors of a new frame against the index of the previous frame (if any), then replace the index
+    // with one built on the new descriptors
+    void matchNext(const cv::Mat &descCurr, std::vector<cv::DMatch> &matches);
+
+    double lastBuildTime() const { return tBuild; } // [s] index construction for the latest frame
+    double lastQueryTime() const { return tQuery; } // [s] matching of the latest frame against the previous index
+
+private:
+    void buildIndex(const cv::Mat &descriptors);
+    void queryIndex(const cv::Mat &descQuery, std::vector<cv::DMatch> &matches);
+
+    enum IndexKind { NO_INDEX, SIMD_INDEX, LSH_INDEX, CV_INDEX };
+
+    std::string matcherType, descriptorType, selectorType;
+    double minDescDistRatio;
+
+    IndexKind indexKind;
+    cv::Mat indexedDesc;                       // descriptors of the previous frame (float copy for FLANN)
+    cv::Ptr<cv::DescriptorMatcher> cvMatcher;  // trained matcher for MAT_BF and MAT_FLANN
+    LshIndex lshIndex;                         // index for MAT_LSH
+    double tBuild, tQuery;
+};
+
+#endif /* sequenceMatcher_hpp */
@@ -0,0 +1,142 @@
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#include <memory>
+
+#include "stageTimer.hpp"
+
+using namespace std;
+
+static atomic<bool> timingEnabled(false);
+static mutex registryMutex; // only taken when a call site registers its histogram and when reporting
+static vector<unique_ptr<StageHistogram>> registry;
+
+static int bucketIndex(uint64_t ns)
+{
+    if (ns < 16)
+        return (int)ns;
+    int e = 63 - __builtin_clzll(ns); // position of the leading bit, at least 4
+    return (e - 3) * 16 + (int)((ns >> (e - 4)) & 15);
+}
+
+static uint64_t bucketUpperBound(int idx)
+{
+    if (idx < 16)
+        return (uint64_t)idx;
+    int e = idx / 16 + 3;
+    uint64_t lower = (uint64_t)(16 + idx % 16) << (e - 4);
+    return lower + ((uint64_t)1 << (e - 4)) - 1;
+}
+
+StageHistogram::StageHistogram(const std::string &name) : stageName(name), n(0), sum(0), maxNs(0)
+{
+    for (auto &bucket : buckets)
+        bucket.store(0, memory_order_relaxed);
+}
+
+void StageHistogram::record(uint64_t ns)
+{
+    buckets[bucketIndex(ns)].fetch_add(1, memory_order_relaxed);
+    n.fetch_add(1, memory_order_relaxed);
+    sum.fetch_add(ns, memory_order_relaxed);
+    uint64_t prevMax = maxNs.load(memory_order_relaxed);
+    while (ns > prevMax && !maxNs.compare_exchange_weak(prevMax, ns, memory_order_relaxed))
+        ;
+}
+
+uint64_t StageHistogram::percentile(double p) const
+{
+    uint64_t total = count();
+    if (total == 0)
+        return 0;
+    // rank of the sample, 1-based, rounded up so that p = 100 returns the bucket of the maximum
+    uint64_t rank = std::max((uint64_t)1, (uint64_t)(p / 100.0 * total + 0.999999));
+    uint64_t seen = 0;
+    for (int i = 0; i < nBuckets; ++i)
+    {
+        seen += buckets[i].load(memory_order_relaxed);
+        if (seen >= rank)
+            return min(bucketUpperBound(i), max());
+    }
+    return max();
+}
+
+StageHistogram &stageHistogram(const std::string &name)
+{
+    lock_guard<mutex> lock(registryMutex);
+    for (auto &histogram : registry)
+        if (histogram->name() == name)
+            return *histogram;
+    registry.push_back(unique_ptr<StageHistogram>(new StageHistogram(name)));
+    return *registry.back();
+}
+
+void setStageTiming(bool enabled)
+{
+    timingEnabled.store(enabled, memory_order_relaxed);
+}
+
+bool stageTimingEnabled()
+{
+    return timingEnabled.load(memory_order_relaxed);
+}
+
+void reportStageTimings()
+{
+    lock_guard<mutex> lock(registryMutex);
+    cout << "Stage timings [ms]:" << endl;
+    cout << "  " << left << setw(32) << "stage" << right << setw(8) << "runs" << setw(10) << "mean" << setw(10) << "p50"
+         << setw(10) << "p95" << setw(10) << "p99" << setw(10) << "max" << endl;
+    cout << fixed << setprecision(3);
+    for (const auto &h : registry)
+    {
+        if (h->count() == 0)
+            continue;
+        cout << "  " << left << setw(32) << h->name() << right << setw(8) << h->count() << setw(10) << 1e-6 * h->total() / h->count()
+             << setw(10) << 1e-6 * h->percentile(50) << setw(10) << 1e-6 * h->percentile(95) << setw(10) << 1e-6 * h->percentile(99)
+             << setw(10) << 1e-6 * h->max() << endl;
+    }
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+}
+
+bool writeStageTimings(const std::string &fileName)
+{
+    ofstream out(fileName.c_str());
+    if (!out)
+        return false;
+    bool bJson = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+
+    lock_guard<mutex> lock(registryMutex);
+    out << fixed << setprecision(6);
+    if (bJson)
+        out << "[" << endl;
+    else
+        out << "stage,runs,mean_ms,p50_ms,p95_ms,p99_ms,max_ms" << endl;
+    bool bFirst = true;
+    for (const auto &h : registry)
+    {
+        if (h->count() == 0)
+            continue;
+        double mean = 1e-6 * h->total() / h->count();
+        if (bJson)
+        {
+            // stage names are plain identifiers, no escaping needed
+            out << (bFirst ? "" : ",\n") << "  {\"stage\": \"" << h->name() << "\", \"runs\": " << h->count()
+                << ", \"mean_ms\": " << mean << ", \"p50_ms\": " << 1e-6 * h->percentile(50) << ", \"p95_ms\": " << 1e-6 * h->percentile(95)
+                << ", \"p99_ms\": " << 1e-6 * h->percentile(99) << ", \"max_ms\": " << 1e-6 * h->max() << "}";
+        }
+        else
+        {
+            out << h->name() << "," << h->count() << "," << mean << "," << 1e-6 * h->percentile(50) << "," << 1e-6 * h->percentile(95)
+                << "," << 1e-6 * h->percentile(99) << "," << 1e-6 * h->max() << endl;
+        }
+        bFirst = false;
+    }
+    if (bJson)
+        out << (bFirst ? "" : "\n") << "]" << endl;
+    return true;
+}
@@ -0,0 +1,107 @@
+#ifndef stageTimer_hpp
+#define stageTimer_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <opencv2/core.hpp>
+
+#include "traceEvents.hpp"
+
+// Latency histogram of one named stage. Durations go into log-linear buckets (16 per power of two, so percentiles are
+// within 6 % of the true value) with relaxed atomic increments, which lets any thread record without a lock.
+class StageHistogram {
+public:
+    explicit StageHistogram(const std::string &name);
+
+    void record(uint64_t ns);
+    uint64_t percentile(double p) const; // upper bound of the bucket holding the p-th percentile, in ns
+    uint64_t count() const { return n.load(std::memory_order_relaxed); }
+    uint64_t total() const { return sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maxNs.load(std::memory_order_relaxed); }
+    const std::string &name() const { return stageName; }
+
+    static const int nBuckets = 61 * 16;
+
+private:
+    std::string stageName;
+    std::atomic<uint64_t> buckets[nBuckets];
+    std::atomic<uint64_t> n, sum, maxNs;
+};
+
+// Histogram registered under the given name; created on first use and kept until the end of the process
+StageHistogram &stageHistogram(const std::string &name);
+
+void setStageTiming(bool enabled); // off by default, timers then only read the clock for elapsed()
+bool stageTimingEnabled();
+
+// p50, p95, p99 and max per stage, in order of registration
+void reportStageTimings();
+bool writeStageTimings(const std::string &fileName); // CSV, or JSON when the name ends with .json
+
+#ifndef NO_STAGE_TIMING
+
+// Records the time from construction to stop() or destruction into a stage histogram, and as a span when tracing;
+// elapsed() gives the same duration to callers which also report it
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(StageHistogram &histogram)
+        : histogram(histogram), span(histogram.name().c_str()), bRecord(stageTimingEnabled()),
+          start(cv::getTickCount()), stopTicks(0) {}
+    ~ScopedStageTimer() { stop(); }
+
+    void stop()
+    {
+        if (stopTicks != 0)
+            return;
+        stopTicks = cv::getTickCount();
+        span.end();
+        if (bRecord)
+            histogram.record((uint64_t)((stopTicks - start) * (1e9 / cv::getTickFrequency())));
+    }
+
+    // seconds from construction to stop(), or to now while running
+    double elapsed() const { return ((stopTicks != 0 ? stopTicks : cv::getTickCount()) - start) / cv::getTickFrequency(); }
+
+private:
+    StageHistogram &histogram;
+    ScopedTraceSpan span;
+    bool bRecord;
+    int64_t start, stopTicks;
+};
+
+// the histogram of a string literal name is looked up once per call site, later passes only pay for the timer itself
+#define STAGE_HISTOGRAM(name) ([]() -> StageHistogram & { static StageHistogram &h = stageHistogram(name); return h; }())
+
+#else
+
+// compiled out: the histograms are never registered and timers only record trace spans and their elapsed time
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(const char *name) : span(name), start(cv::getTickCount()), stopTicks(0) {}
+
+    void stop()
+    {
+        if (stopTicks != 0)
+            return;
+        stopTicks = cv::getTickCount();
+        span.end();
+    }
+
+    double elapsed() const { return ((stopTicks != 0 ? stopTicks : cv::getTickCount()) - start) / cv::getTickFrequency(); }
+
+private:
+    ScopedTraceSpan span;
+    int64_t start, stopTicks;
+};
+
+#define STAGE_HISTOGRAM(name) name
+
+#endif
+
+#define STAGE_TIMER_NAME2(line) stageTimer_##line
+#define STAGE_TIMER_NAME(line) STAGE_TIMER_NAME2(line)
+// times the rest of the enclosing scope
+#define STAGE_TIMER(name) ScopedStageTimer STAGE_TIMER_NAME(__LINE__)(STAGE_HISTOGRAM(name))
+
+#endif /* stageTimer_hpp */
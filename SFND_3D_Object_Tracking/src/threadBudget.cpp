@@ -0,0 +1,174 @@
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/core.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "threadBudget.hpp"
+
+using namespace std;
+
+ThreadBudget::ThreadBudget(int nCores, int reservedCores)
+    : nCores(nCores > 0 ? nCores : cv::getNumberOfCPUs()), defaultThreads(-1), appliedThreads(-1), current(-1), enterVoluntary(0), enterInvoluntary(0)
+{
+    this->reservedCores = min(max(0, reservedCores), this->nCores - 1);
+}
+
+void ThreadBudget::setStage(const std::string &stage, double share)
+{
+    int threads = max(1, (int)round(share * (nCores - reservedCores)));
+    for (auto &s : stages)
+    {
+        if (s.name == stage)
+        {
+            s.threads = threads;
+            return;
+        }
+    }
+    Stage s;
+    s.name = stage;
+    s.threads = threads;
+    s.entries = 0;
+    s.voluntarySwitches = s.involuntarySwitches = 0;
+    s.runQueueSum = s.runQueueMax = 0;
+    stages.push_back(s);
+}
+
+int ThreadBudget::stageThreads(const std::string &stage) const
+{
+    for (const auto &s : stages)
+        if (s.name == stage)
+            return s.threads;
+    return 0;
+}
+
+void ThreadBudget::enterStage(const std::string &stage)
+{
+    leaveStage();
+    for (size_t i = 0; i < stages.size(); ++i)
+    {
+        if (stages[i].name != stage)
+            continue;
+
+        if (defaultThreads < 0)
+            defaultThreads = appliedThreads = cv::getNumThreads();
+        applyThreads(stages[i].threads);
+
+        Stage &s = stages[i];
+        ++s.entries;
+        int runQueue = runQueueLength();
+        if (runQueue >= 0)
+        {
+            s.runQueueSum += runQueue;
+            s.runQueueMax = max(s.runQueueMax, (long)runQueue);
+        }
+        contextSwitches(enterVoluntary, enterInvoluntary);
+        current = (int)i;
+        return;
+    }
+}
+
+void ThreadBudget::leaveStage()
+{
+    if (current < 0)
+        return;
+    long voluntary, involuntary;
+    if (contextSwitches(voluntary, involuntary))
+    {
+        stages[current].voluntarySwitches += voluntary - enterVoluntary;
+        stages[current].involuntarySwitches += involuntary - enterInvoluntary;
+    }
+    current = -1;
+}
+
+void ThreadBudget::restoreThreads()
+{
+    leaveStage();
+    if (defaultThreads >= 0)
+        applyThreads(defaultThreads);
+}
+
+void ThreadBudget::applyThreads(int threads)
+{
+    // every call resizes OpenCV's thread pool, which stops or starts workers
+    if (threads == appliedThreads)
+        return;
+    cv::setNumThreads(threads);
+    appliedThreads = threads;
+}
+
+bool ThreadBudget::contextSwitches(long &voluntary, long &involuntary)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    // RUSAGE_SELF sums over all threads of the process, including OpenCV's workers
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        voluntary = usage.ru_nvcsw;
+        involuntary = usage.ru_nivcsw;
+        return true;
+    }
+#endif
+    voluntary = involuntary = 0;
+    return false;
+}
+
+int ThreadBudget::runQueueLength()
+{
+#ifdef __linux__
+    // runnable tasks on the whole host, including the calling thread
+    ifstream stat("/proc/stat");
+    string line;
+    while (getline(stat, line))
+    {
+        if (line.compare(0, 14, "procs_running ") == 0)
+            return atoi(line.c_str() + 14);
+    }
+#endif
+    return -1;
+}
+
+bool ThreadBudget::pinToCores()
+{
+#ifdef __linux__
+    cpu_set_t allowed, pinned;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return false;
+    CPU_ZERO(&pinned);
+    int nPinned = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && nPinned < nCores; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+        {
+            CPU_SET(cpu, &pinned);
+            ++nPinned;
+        }
+    }
+    return sched_setaffinity(0, sizeof(pinned), &pinned) == 0;
+#else
+    return false;
+#endif
+}
+
+void ThreadBudget::report() const
+{
+    cout << "Thread budget: " << nCores << " cores, " << reservedCores << " reserved for pipeline workers" << endl;
+    for (const auto &s : stages)
+    {
+        if (s.entries == 0)
+            continue;
+        cout << "  " << s.name << ": " << s.threads << " OpenCV threads, " << s.entries << " runs, context switches "
+             << (double)s.voluntarySwitches / s.entries << " voluntary / " << (double)s.involuntarySwitches / s.entries
+             << " involuntary per run, run queue " << (double)s.runQueueSum / s.entries << " mean / " << s.runQueueMax << " max" << endl;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef threadBudget_hpp
+#define threadBudget_hpp
+
+#include <vector>
+#include <string>
+
+// Central split of the CPU cores between the pipeline stages. Every stage gets a share of the budget's cores for
+// OpenCV's parallel regions (DNN, cornerHarris, goodFeaturesToTrack, the parallel matchers), applied with
+// cv::setNumThreads when entering the stage changes the thread count (resizing OpenCV's pool stops or starts workers,
+// so the count is not reset between stages); cores reserved for pipeline workers outside OpenCV are never handed to
+// it, so both together do not oversubscribe the machine. Per stage, the budget records the context switches of the
+// process (getrusage) and the run queue length of the host (procs_running in /proc/stat) for latency tuning on shared
+// hosts. Stages which have not been configured are not tracked, so an empty budget costs nothing.
+class ThreadBudget {
+public:
+    // nCores: cores available to this process, 0 for all online cores; reservedCores: cores kept for pipeline workers
+    explicit ThreadBudget(int nCores=0, int reservedCores=0);
+
+    void setStage(const std::string &stage, double share); // share of the budget's OpenCV cores for the stage
+    int stageThreads(const std::string &stage) const;      // OpenCV threads of the stage, 0 if not configured
+    int workerThreads() const { return reservedCores; }    // threads pipeline workers may run next to OpenCV
+
+    // leaves the current stage and enters the given one (no-op for unconfigured stages); leaveStage ends the current one
+    // and keeps its thread count, restoreThreads ends it and gives OpenCV its thread count from before the first stage
+    void enterStage(const std::string &stage);
+    void leaveStage();
+    void restoreThreads();
+
+    // Linux: restricts the process to the first nCores cores of its current affinity mask; call before OpenCV creates
+    // its worker threads, which inherit the mask. Returns false if affinity is not supported.
+    bool pinToCores();
+
+    void report() const; // per stage: threads, entries, context switches and run queue statistics
+
+private:
+    struct Stage {
+        std::string name;
+        int threads;
+        int entries;
+        long voluntarySwitches, involuntarySwitches;
+        long runQueueSum, runQueueMax;
+    };
+
+    void applyThreads(int threads);
+    static bool contextSwitches(long &voluntary, long &involuntary);
+    static int runQueueLength(); // -1 if unavailable
+
+    int nCores, reservedCores;
+    int defaultThreads; // cv::getNumThreads() before the first stage, restored by restoreThreads
+    int appliedThreads; // last value given to cv::setNumThreads, -1 before the first stage
+    std::vector<Stage> stages;
+    int current;        // index of the current stage, -1 outside of stages
+    long enterVoluntary, enterInvoluntary;
+};
+
+#endif /* threadBudget_hpp */
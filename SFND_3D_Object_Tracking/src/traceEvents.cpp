@@ -0,0 +1,191 @@
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "traceEvents.hpp"
+
+using namespace std;
+
+struct TraceEvent {
+    const char *name;
+    int64_t ticks;
+    int frame;
+    char phase;
+};
+
+// single producer (the owning thread), single consumer (the flush thread)
+struct ThreadBuffer {
+    static const uint64_t capacity = 1 << 14; // ~1.5 s of events at 10 kHz, far more than one flush interval
+
+    long tid;
+    vector<TraceEvent> ring;
+    atomic<uint64_t> head, tail;
+    atomic<uint64_t> dropped;
+
+    explicit ThreadBuffer(long tid) : tid(tid), ring(capacity), head(0), tail(0), dropped(0) {}
+};
+
+static atomic<bool> enabled(false);
+static atomic<int> pipelineFrame(-1);
+static thread_local ThreadBuffer *threadBuffer = nullptr;
+static thread_local int threadFrame = -1;
+
+static mutex registryMutex; // taken when a thread records its first event and by the flush thread
+static vector<unique_ptr<ThreadBuffer>> buffers; // kept after their threads exit, their events may not be written yet
+
+static ofstream traceFile;
+static int64_t startTicks = 0;
+static bool bFirstEvent = true;
+static thread flushThread;
+static mutex flushMutex;
+static condition_variable flushWakeup;
+static bool bStopFlush = false;
+
+static long currentThreadID()
+{
+#ifdef __linux__
+    return (long)syscall(SYS_gettid);
+#else
+    static atomic<long> nextID(1);
+    return nextID.fetch_add(1);
+#endif
+}
+
+static ThreadBuffer *ownBuffer()
+{
+    if (!threadBuffer)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        buffers.push_back(unique_ptr<ThreadBuffer>(new ThreadBuffer(currentThreadID())));
+        threadBuffer = buffers.back().get();
+    }
+    return threadBuffer;
+}
+
+static void record(const char *name, char phase)
+{
+    ThreadBuffer *buffer = ownBuffer();
+    uint64_t head = buffer->head.load(memory_order_relaxed);
+    if (head - buffer->tail.load(memory_order_acquire) >= ThreadBuffer::capacity)
+    {
+        buffer->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    TraceEvent &event = buffer->ring[head & (ThreadBuffer::capacity - 1)];
+    event.name = name;
+    event.ticks = cv::getTickCount();
+    event.frame = threadFrame >= 0 ? threadFrame : pipelineFrame.load(memory_order_relaxed);
+    event.phase = phase;
+    buffer->head.store(head + 1, memory_order_release);
+}
+
+// writes the events recorded so far; only called by the flush thread, or after it has ended
+static void drainBuffers()
+{
+    vector<ThreadBuffer *> snapshot;
+    {
+        lock_guard<mutex> lock(registryMutex);
+        for (auto &buffer : buffers)
+            snapshot.push_back(buffer.get());
+    }
+
+    double usPerTick = 1e6 / cv::getTickFrequency();
+    for (ThreadBuffer *buffer : snapshot)
+    {
+        uint64_t tail = buffer->tail.load(memory_order_relaxed);
+        uint64_t head = buffer->head.load(memory_order_acquire);
+        for (; tail != head; ++tail)
+        {
+            const TraceEvent &event = buffer->ring[tail & (ThreadBuffer::capacity - 1)];
+            traceFile << (bFirstEvent ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase
+                      << "\",\"ts\":" << (event.ticks - startTicks) * usPerTick << ",\"pid\":1,\"tid\":" << buffer->tid
+                      << ",\"args\":{\"frame\":" << event.frame << "}}";
+            bFirstEvent = false;
+        }
+        buffer->tail.store(tail, memory_order_release);
+    }
+}
+
+static void flushLoop()
+{
+    unique_lock<mutex> lock(flushMutex);
+    while (!bStopFlush)
+    {
+        flushWakeup.wait_for(lock, chrono::milliseconds(20));
+        drainBuffers();
+    }
+}
+
+bool startTrace(const std::string &fileName)
+{
+    if (enabled.load())
+        return true;
+    traceFile.open(fileName.c_str());
+    if (!traceFile)
+        return false;
+    traceFile << fixed << setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    startTicks = cv::getTickCount();
+    bFirstEvent = true;
+    bStopFlush = false;
+    flushThread = thread(flushLoop);
+    enabled.store(true);
+    return true;
+}
+
+void stopTrace()
+{
+    if (!enabled.exchange(false))
+        return;
+    {
+        lock_guard<mutex> lock(flushMutex);
+        bStopFlush = true;
+    }
+    flushWakeup.notify_one();
+    flushThread.join();
+    drainBuffers(); // events recorded while the flush thread was finishing
+
+    uint64_t dropped = 0;
+    {
+        // a thread recording its first event may be registering its buffer right now
+        lock_guard<mutex> lock(registryMutex);
+        for (auto &buffer : buffers)
+            dropped += buffer->dropped.load();
+    }
+    traceFile << "\n],\"otherData\":{\"droppedEvents\":" << dropped << "}}" << endl;
+    traceFile.close();
+}
+
+bool traceEnabled()
+{
+    return enabled.load(memory_order_relaxed);
+}
+
+void setTraceFrame(int frame)
+{
+    threadFrame = frame;
+    pipelineFrame.store(frame, memory_order_relaxed);
+}
+
+void traceBegin(const char *name)
+{
+    record(name, 'B');
+}
+
+void traceEnd(const char *name)
+{
+    record(name, 'E');
+}
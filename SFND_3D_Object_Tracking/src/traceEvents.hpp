@@ -0,0 +1,58 @@
+#ifndef traceEvents_hpp
+#define traceEvents_hpp
+
+#include <string>
+
+// Trace-event export for chrome://tracing and Perfetto. Every thread appends begin and end events to its own
+// lock-free ring; a background thread drains the rings every few milliseconds and writes the JSON file, so recording
+// a span never waits for I/O. Each event carries the frame index of the recording thread (or, for worker threads
+// which never set one, the frame the pipeline is currently on) and its thread ID.
+
+bool startTrace(const std::string &fileName); // false if the file cannot be written
+void stopTrace(); // write the remaining events and close the file
+bool traceEnabled();
+
+void setTraceFrame(int frame); // frame index attached to the following events of this thread
+
+// names must have static storage duration (string literals, __func__), only the pointer is kept until the flush
+void traceBegin(const char *name);
+void traceEnd(const char *name);
+
+#ifndef NO_TRACE
+
+class ScopedTraceSpan {
+public:
+    explicit ScopedTraceSpan(const char *name) : name(traceEnabled() ? name : nullptr)
+    {
+        if (this->name)
+            traceBegin(this->name);
+    }
+    ~ScopedTraceSpan() { end(); }
+
+    void end()
+    {
+        if (name)
+            traceEnd(name);
+        name = nullptr;
+    }
+
+private:
+    const char *name;
+};
+
+#else
+
+class ScopedTraceSpan {
+public:
+    explicit ScopedTraceSpan(const char *) {}
+    void end() {}
+};
+
+#endif
+
+#define TRACE_SPAN_NAME2(line) traceSpan_##line
+#define TRACE_SPAN_NAME(line) TRACE_SPAN_NAME2(line)
+#define TRACE_SPAN(name) ScopedTraceSpan TRACE_SPAN_NAME(__LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SPAN(__func__)
+
+#endif /* traceEvents_hpp */
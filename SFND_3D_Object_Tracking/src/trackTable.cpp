@@ -0,0 +1,144 @@
+
+#include <iostream>
+#include <algorithm>
+
+#include "trackTable.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+TrackTable::TrackTable(int historyLength)
+    : historyLength(max(2, historyLength)), frameIndex(-1), nextTrackId(0), obsBase(0)
+{
+}
+
+void TrackTable::addFrame(const std::vector<cv::KeyPoint> &kpts, const std::vector<cv::DMatch> &matches)
+{
+    ++frameIndex;
+
+    // a track continues with the first current keypoint it is matched to, a keypoint matched from several previous
+    // keypoints continues the first of their tracks only
+    vector<int> kptTrack(kpts.size(), -1);
+    vector<uchar> trackExtended(trackId.size(), 0);
+    for (const auto &match : matches)
+    {
+        int track = match.queryIdx < (int)currKptTrack.size() ? currKptTrack[match.queryIdx] : -1;
+        if (track < 0 || trackExtended[track] || kptTrack[match.trainIdx] >= 0)
+            continue;
+        kptTrack[match.trainIdx] = track;
+        trackExtended[track] = 1;
+    }
+
+    frameObsBegin.push_back(obsBase + (int)obsTrack.size());
+    for (size_t i = 0; i < kpts.size(); ++i)
+    {
+        int track = kptTrack[i];
+        if (track < 0)
+        {
+            track = (int)trackId.size();
+            trackId.push_back(nextTrackId++);
+            trackLastObs.push_back(-1);
+            trackLen.push_back(0);
+            kptTrack[i] = track;
+        }
+
+        int obs = obsBase + (int)obsTrack.size();
+        obsTrack.push_back(track);
+        obsFrame.push_back(frameIndex);
+        obsX.push_back(kpts[i].pt.x);
+        obsY.push_back(kpts[i].pt.y);
+        obsPrev.push_back(trackLastObs[track]);
+        trackLastObs[track] = obs;
+        ++trackLen[track];
+    }
+    currKptTrack.swap(kptTrack);
+
+    while ((int)frameObsBegin.size() > historyLength)
+        dropOldestFrame();
+
+    // ended tracks keep their slots until they outnumber the active ones
+    int nActive = activeTrackCount();
+    if (trackCount() > 2 * nActive + 256)
+        compactTracks();
+}
+
+void TrackTable::dropOldestFrame()
+{
+    int nDrop = frameObsBegin[1] - frameObsBegin[0];
+    obsTrack.erase(obsTrack.begin(), obsTrack.begin() + nDrop);
+    obsFrame.erase(obsFrame.begin(), obsFrame.begin() + nDrop);
+    obsX.erase(obsX.begin(), obsX.begin() + nDrop);
+    obsY.erase(obsY.begin(), obsY.begin() + nDrop);
+    obsPrev.erase(obsPrev.begin(), obsPrev.begin() + nDrop);
+    obsBase += nDrop;
+    frameObsBegin.erase(frameObsBegin.begin());
+}
+
+void TrackTable::compactTracks()
+{
+    // keep the tracks of the newest frame, in the order of their slots
+    vector<int> newSlot(trackId.size(), -1);
+    int nKept = 0;
+    for (size_t track = 0; track < trackId.size(); ++track)
+    {
+        if (trackLastObs[track] >= frameObsBegin.back())
+        {
+            newSlot[track] = nKept;
+            trackId[nKept] = trackId[track];
+            trackLastObs[nKept] = trackLastObs[track];
+            trackLen[nKept] = trackLen[track];
+            ++nKept;
+        }
+    }
+    trackId.resize(nKept);
+    trackLastObs.resize(nKept);
+    trackLen.resize(nKept);
+
+    for (auto &track : obsTrack)
+        track = track >= 0 ? newSlot[track] : -1;
+    for (auto &track : currKptTrack)
+        track = newSlot[track];
+}
+
+int TrackTable::activeTrackCount() const
+{
+    // every track has at most one observation per frame, so the newest frame's observations are the active tracks
+    return frameObsBegin.empty() ? 0 : obsBase + (int)obsTrack.size() - frameObsBegin.back();
+}
+
+void TrackTable::correspondences(int nFramesBack, const cv::Rect &roi, std::vector<cv::KeyPoint> &kptsOld,
+                                 std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &matches) const
+{
+    kptsOld.clear();
+    kptsCurr.clear();
+    matches.clear();
+    if (nFramesBack <= 0 || nFramesBack >= frameCount())
+        return;
+
+    int oldFrame = frameIndex - nFramesBack;
+    for (int obs = frameObsBegin.back(); obs < obsBase + (int)obsTrack.size(); ++obs)
+    {
+        int o = obs - obsBase;
+        cv::Point2f ptCurr(obsX[o], obsY[o]);
+        if (trackLen[obsTrack[o]] <= nFramesBack || !roi.contains(ptCurr))
+            continue;
+
+        // tracks are observed in consecutive frames, so the observation nFramesBack steps back is in oldFrame
+        int prev = obs;
+        for (int k = 0; k < nFramesBack && prev >= obsBase; ++k)
+            prev = obsPrev[prev - obsBase];
+        if (prev < obsBase || obsFrame[prev - obsBase] != oldFrame)
+            continue;
+
+        matches.push_back(cv::DMatch((int)kptsOld.size(), (int)kptsCurr.size(), 0, 0.0f));
+        kptsOld.push_back(cv::KeyPoint(obsX[prev - obsBase], obsY[prev - obsBase], 1.0f));
+        kptsCurr.push_back(cv::KeyPoint(ptCurr, 1.0f));
+    }
+}
+
+void updateTrackTable(TrackTable &tracks, const std::vector<cv::KeyPoint> &kpts, const std::vector<cv::DMatch> &matches)
+{
+    tracks.addFrame(kpts, matches);
+
+    LOG_DEBUG("Track table: ", tracks.activeTrackCount(), " active tracks in ", tracks.trackCount(), " slots");
+}
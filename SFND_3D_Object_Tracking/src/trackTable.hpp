@@ -0,0 +1,59 @@
+#ifndef trackTable_hpp
+#define trackTable_hpp
+
+#include <vector>
+#include <string>
+#include <opencv2/core.hpp>
+
+// Store of keypoint tracks over the last historyLength frames in struct-of-arrays layout. Every track has a persistent
+// ID, and every observation records the track, frame and position of one keypoint plus a link to the previous
+// observation of the same track. Keypoint matches between the previous and the newest frame extend tracks, all other
+// keypoints of the newest frame start new tracks. Tracks which are not extended end; their slots are reclaimed once
+// there are many of them. The table serves the multi-frame camera TTC; it does not save description or matching work.
+class TrackTable {
+public:
+    explicit TrackTable(int historyLength=10);
+
+    // Appends a frame. matches link keypoints of the previous frame (queryIdx) to kpts (trainIdx) as in DataFrame::kptMatches.
+    void addFrame(const std::vector<cv::KeyPoint> &kpts, const std::vector<cv::DMatch> &matches);
+
+    // Keypoint correspondences between the frame nFramesBack frames before the newest one and the newest frame for all
+    // tracks which cover both frames and whose newest keypoint lies in roi. kptsOld[i] and kptsCurr[i] belong to the same
+    // track and are linked by matches[i].
+    void correspondences(int nFramesBack, const cv::Rect &roi, std::vector<cv::KeyPoint> &kptsOld,
+                         std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &matches) const;
+
+    int frameCount() const { return (int)frameObsBegin.size(); } // frames held in the table (at most historyLength)
+    int trackCount() const { return (int)trackId.size(); }       // track slots including ended tracks
+    int activeTrackCount() const;                                // tracks observed in the newest frame
+
+private:
+    void dropOldestFrame();
+    void compactTracks();
+
+    int historyLength;
+    int frameIndex;  // index of the newest frame since the start of the sequence
+    int nextTrackId;
+
+    // per track
+    std::vector<int> trackId;
+    std::vector<int> trackLastObs; // observation index of the newest observation
+    std::vector<int> trackLen;
+
+    // per observation, observation i is stored at i - obsBase (older observations have been dropped)
+    std::vector<int> obsTrack;     // track slot, -1 once the track slot has been reclaimed
+    std::vector<int> obsFrame;
+    std::vector<float> obsX, obsY;
+    std::vector<int> obsPrev;      // previous observation of the same track, -1 for the first one
+    int obsBase;
+
+    // per frame in the table, oldest first
+    std::vector<int> frameObsBegin; // index of the first observation of the frame
+
+    std::vector<int> currKptTrack;  // track slot of every keypoint of the newest frame
+};
+
+// Adds a frame to the track table, continuing tracks through the matches (or KLT correspondences) of the frame.
+void updateTrackTable(TrackTable &tracks, const std::vector<cv::KeyPoint> &kpts, const std::vector<cv::DMatch> &matches);
+
+#endif /* trackTable_hpp */